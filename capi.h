@@ -29,7 +29,19 @@
 #include <cstddef> //ptrdiff_t
 #include <cstdio>
 #include <cassert>
+#include <stdlib.h>
 #include <string.h>
+#include <stdint.h>
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
 
 #define CAPI_IS(X) (defined CAPI_IS_##X && CAPI_IS_##X)
 /*!
@@ -39,6 +51,58 @@
 #ifndef CAPI_IS_LAZY_RESOLVE
 #define CAPI_IS_LAZY_RESOLVE 1
 #endif
+/*!
+ * you can define CAPI_IS_TRAMPOLINE 1 before including capi.h to use self patching entries with lazy resolve.
+ * an entry points to a resolver stub at first, the stub resolves the symbol, patches the entry and calls the real function.
+ * then a call is only an indirect call without any check. entries are shared by all api objects, and resolved by the namespace style dll object,
+ * so the library is loaded and kept until exit once any entry is called, even if only class style api objects are used.
+ * ::capi::isolated_dso is not supported because all copies would share 1 table
+ */
+#if CAPI_IS(TRAMPOLINE) && !CAPI_IS(LAZY_RESOLVE)
+# error "CAPI_IS_TRAMPOLINE requires CAPI_IS_LAZY_RESOLVE"
+#endif
+/*!
+ * you can define CAPI_IS_PROFILE_RESOLVE 1 before including capi.h to resolve symbols used in previous runs when the library is loaded, and lazily resolve others.
+ * entries resolved in a run are saved in a profile file in symbol cache directory(see setSymbolCacheDir()) when api_dll is destroyed or at exit for namespace style,
+ * and the next run resolves them in a background thread after loading.
+ */
+#if CAPI_IS(PROFILE_RESOLVE) && !CAPI_IS(LAZY_RESOLVE)
+# error "CAPI_IS_PROFILE_RESOLVE requires CAPI_IS_LAZY_RESOLVE"
+#endif
+/*!
+ * you can define CAPI_IS_STATS 1 before including capi.h to count calls of each entry in per-thread counters, see capi::stats.
+ * define CAPI_IS_STATS_LATENCY 1 to also record the latency histogram of each entry, measured by std::chrono::steady_clock in ns,
+ * or by rdtsc in cycles if CAPI_IS_STATS_RDTSC is 1 on x86. no code is generated if CAPI_IS_STATS is not 1.
+ */
+/*!
+ * you can define CAPI_IS_RELOAD 1 before including capi.h to support reloading the library in namespace style, see capi::reload() in CAPI_DEFINE_NS_DLL.
+ * a namespace style call protects the dll object it uses by a per-thread hazard pointer, so reload() can delete the old one once no call is using it
+ */
+#if CAPI_IS(RELOAD) && CAPI_IS(TRAMPOLINE)
+# error "CAPI_IS_RELOAD does not support CAPI_IS_TRAMPOLINE"
+#endif
+#if CAPI_IS(STATS_LATENCY) && !CAPI_IS(STATS)
+# error "CAPI_IS_STATS_LATENCY requires CAPI_IS_STATS"
+#endif
+/*!
+ * you can define CAPI_IS_TRACE 1 before including capi.h to record load, resolve and call events as fixed size binary records in per-thread ring buffers
+ * of CAPI_TRACE_RING_SIZE records, see capi::trace. unlike DEBUG_LOAD etc., no string is formatted and nothing is written until dump.
+ */
+#ifndef CAPI_TRACE_RING_SIZE
+#define CAPI_TRACE_RING_SIZE 1024
+#endif
+#ifndef CAPI_RESOLVE_CACHE_SIZE
+#define CAPI_RESOLVE_CACHE_SIZE 1024
+#endif
+// slow paths shared by all wrappers of a library, e.g. resolve. not inlined, so a wrapper is only the fast path and a call
+#if defined(_MSC_VER)
+#define CAPI_NOINLINE __declspec(noinline)
+#elif defined(__GNUC__)
+#define CAPI_NOINLINE __attribute__((noinline))
+#else
+#define CAPI_NOINLINE
+#endif
+#include <vector>
 namespace capi {
 namespace version {
     enum {
@@ -52,6 +116,70 @@ enum {
     NoVersion = -1, /// library name without major version, for example libz.so
     EndVersion = -2
 };
+// library load flags of dso. \sa CAPI_BEGIN_DLL_FLAGS. ignored on windows except ResolveCache
+enum {
+    LoadNow = 1, /// RTLD_NOW. bind all undefined symbols of the library and dependencies loaded with it when loading instead of at the first calls
+    LoadDeepBind = 1<<1, /// RTLD_DEEPBIND. prefer symbols in the library and its dependencies to global symbols
+    LoadGlobal = 1<<2, /// RTLD_GLOBAL. make symbols of the library available to libraries loaded later
+    LoadNeeded = 1<<3, /// page in the library and its DT_NEEDED dependency chain when loading, so that the first calls don't page fault. ELF only
+    ResolveCache = 1<<4 /// cache results of resolve(name), including not found, in a fixed size hash table of CAPI_RESOLVE_CACHE_SIZE entries
+};
+/*!
+ * set the file to cache the library path found by probing names x versions in dll_helper. the next process loads the cached path directly,
+ * and the cached path is ignored if its inode, mtime or size changed.
+ * default is environment var CAPI_PROBE_CACHE. empty to disable. must be called before loading any library. not supported on windows.
+ */
+inline void setProbeCacheFile(const char* path);
+/*!
+ * set the directory to cache symbol offsets of batch resolved symbols(all symbols in eager mode). a file is keyed by library build-id and symbol list,
+ * the next process fills the function pointers by load address + offset without symbol lookup if the build-id matches.
+ * default is environment var CAPI_SYMBOL_CACHE. empty to disable. must be called before loading any library. ELF only.
+ */
+inline void setSymbolCacheDir(const char* dir);
+#if CAPI_IS(STATS)
+namespace stats {
+enum { Buckets = 32 };
+struct entry {
+    const char* name;
+    uint64_t calls;
+    uint64_t ticks; // total latency. 0 if CAPI_IS_STATS_LATENCY is not 1
+    uint64_t hist[Buckets]; // hist[i] is the number of calls took [2^(i-1), 2^i) ticks. the last one also counts longer calls
+};
+typedef ::std::vector<entry> snapshot;
+// take a snapshot of all entries of all libraries, counters of all threads are merged
+inline snapshot take();
+// add counters in from to entries of the same name in to, or append
+inline void merge(snapshot& to, const snapshot& from);
+// print called entries
+inline void print(const snapshot& s, FILE* f = stdout);
+} //namespace stats
+#endif
+#if CAPI_IS(TRACE)
+namespace trace {
+enum event {
+    Load, // name: library name, handle: dll_helper, result: loaded or not
+    Resolve, // name: symbol, handle: dll_helper, result: address
+    ResolveAll, // name: null, handle: dll_helper, result: number of resolved symbols
+    Call // name: entry name
+};
+struct record {
+    uint64_t time; // steady_clock ns
+    const char* name; // a literal or an interned copy, valid until exit
+    const void* handle;
+    intptr_t result;
+    int type; // event
+    int thread; // index of thread in the order of the 1st event
+};
+typedef ::std::vector<record> records;
+// records in all threads' ring buffers ordered by time. old records are overwritten if a ring is full
+inline records take();
+// decode records as text
+inline void print(const records& r, FILE* f = stderr);
+inline void dump(FILE* f = stderr) { print(take(), f);}
+// dump to stderr at exit
+inline void dumpAtExit() { atexit([]{ dump(stderr);});}
+} //namespace trace
+#endif
 /********************************** The following code is only used in .cpp **************************************************/
 /*!
   * -Library names:
@@ -70,53 +198,507 @@ enum {
     static const int ver[] = { ::capi::NoVersion, 1, 0, ::capi::EndVersion };
     CAPI_BEGIN_DLL_VER(zlib, ver, ::capi::dso)
     ...
+  * -Load flags
+    bind all symbols and page in the library and dependencies when loading, e.g. in a background thread by preload()
+    CAPI_BEGIN_DLL_FLAGS(zlib, ver, ::capi::LoadNow|::capi::LoadNeeded, ::capi::dso)
+    ...
   */
+namespace internal {
+/*!
+ * an open addressing hash table from a symbol name(including "@VERSION") to the address, or null if not found. keys are 64 bit FNV-1a hashes,
+ * and a copy of the name is compared on a hit, so a hash collision is a miss instead of a wrong address.
+ * lock-free: a writer claims an empty slot by CAS of the key, then publishes the name and value. a reader probes at most kProbes slots with acquire loads.
+ * entries are never evicted, new names are not cached when the probed slots are full. a reloaded dso uses a new cache, see dso::load()
+ */
+class resolve_cache {
+public:
+    enum { kSize = CAPI_RESOLVE_CACHE_SIZE, kProbes = 8 };
+    static_assert(kSize > 0 && (kSize & (kSize - 1)) == 0, "CAPI_RESOLVE_CACHE_SIZE must be a power of 2");
+    static uint64_t hash(const char* s) {
+        uint64_t h = 14695981039346656037ULL;
+        for (; *s; ++s)
+            h = (h ^ (uint8_t)*s) * 1099511628211ULL;
+        return h ? h : 1; // 0 is an empty slot
+    }
+    // retired: the previous cache of the dso, may be used by resolve() in other threads, deleted with this one
+    explicit resolve_cache(resolve_cache* retired = nullptr) : retired(retired) {
+        for (int i = 0; i < kSize; ++i) {
+            slots[i].key.store(0, ::std::memory_order_relaxed);
+            slots[i].name = nullptr;
+            slots[i].value.store(0, ::std::memory_order_relaxed);
+        }
+    }
+    CAPI_NOINLINE ~resolve_cache() { // not inlined in every dso and api_dll destructor
+        for (int i = 0; i < kSize; ++i)
+            free(slots[i].name);
+        delete retired;
+    }
+    // return false if name is not cached
+    bool get(const char* name, uint64_t h, void** addr) const {
+        for (int i = 0; i < kProbes; ++i) {
+            const slot& e = slots[(h + i) & (kSize - 1)];
+            const uint64_t k = e.key.load(::std::memory_order_acquire);
+            if (!k)
+                return false;
+            if (k != h)
+                continue;
+            const uintptr_t v = e.value.load(::std::memory_order_acquire);
+            if (!v) // being written
+                return false;
+            if (strcmp(e.name, name)) // collision
+                continue;
+            *addr = v == kNotFound ? nullptr : (void*)v;
+            return true;
+        }
+        return false;
+    }
+    void put(const char* name, uint64_t h, void* addr) {
+        char* copy = nullptr; // the name may be a temporary string
+        for (int i = 0; i < kProbes; ++i) {
+            slot& e = slots[(h + i) & (kSize - 1)];
+            uint64_t k = e.key.load(::std::memory_order_acquire);
+            if (!k) {
+                if (!copy) {
+                    const size_t len = strlen(name) + 1;
+                    copy = (char*)malloc(len);
+                    if (!copy)
+                        return;
+                    memcpy(copy, name, len);
+                }
+                if (e.key.compare_exchange_strong(k, h, ::std::memory_order_acquire)) {
+                    e.name = copy;
+                    e.value.store(addr ? (uintptr_t)addr : uintptr_t(kNotFound), ::std::memory_order_release);
+                    return;
+                }
+            }
+            const uintptr_t v = k == h ? e.value.load(::std::memory_order_acquire) : 0;
+            if (v && !strcmp(e.name, name)) // added by another thread
+                break;
+        }
+        free(copy);
+    }
+private:
+    static const uintptr_t kNotFound = ~uintptr_t(0);
+    struct slot {
+        ::std::atomic<uint64_t> key;
+        char* name; // published by value
+        ::std::atomic<uintptr_t> value;
+    };
+    resolve_cache* retired;
+    slot slots[kSize];
+};
+} //namespace internal
 class dso {
     void *handle;
-    char full_name[512];
+    const char* full_name; // interned
+    ::std::atomic<internal::resolve_cache*> cache; // created by load() if ResolveCache is set
+    ::std::atomic<signed char> sym_prefix; // 1 if symbols are '_' prefixed, 0 if not, -1 if unknown. decided once per loaded object
     dso(const dso&);
     dso& operator=(const dso&);
 public:
     static inline char* path_from_handle(void* handle, char* path, int path_len);
-    dso(): handle(0) {}
-    virtual ~dso() { unload();}
+    dso(): handle(0), full_name(""), cache(nullptr), sym_prefix(-1), load_flags(0) {}
+    virtual ~dso() { unload(); delete cache.load(::std::memory_order_relaxed);}
+    void setLoadFlags(int flags) { load_flags = flags;} // LoadNow etc.
+    int loadFlags() const { return load_flags;}
     inline void setFileName(const char* name);
     inline void setFileNameAndVersion(const char* name, int ver);
     inline bool load(bool test);
     inline bool unload();
     bool isLoaded() const { return !!handle;}
-    virtual void* resolve(const char* symbol) { return resolve(symbol, true);}
+    virtual inline void* resolve(const char* symbol);
+    // resolve n symbols in 1 pass over the symbol table if possible. return the number of resolved symbols
+    inline int resolve(const char* const* syms, void** addrs, int n);
     const char* path() const { return full_name;} // loaded path
+    void* nativeHandle() const { return handle;} // the same for the same loaded library, e.g. dlopen() of a loaded path
 protected:
-    inline void* load(const char* name, bool test);
+    int load_flags;
+    virtual inline void* load(const char* name, bool test);
     inline bool unload(void* lib);
-    inline void* resolve(const char* sym, bool try_);
+    inline void* lookup(const char* sym); // 1 lookup of the symbol name
+private:
+    inline void* lookup(const char* name, const char* ver); // name without version. ver is null for the default version
+    CAPI_NOINLINE inline void* find(const char* sym); // lookup with the symbol prefix
+    CAPI_NOINLINE inline void* resolve_miss(internal::resolve_cache* c, const char* sym, uint64_t h); // find() and put in cache
+};
+/*!
+ * a dso loading an independent copy of the library and its dependencies in a new link-map namespace by dlmopen(LM_ID_NEWLM),
+ * so libraries with global state can be used by multiple threads in parallel, see capi::pool. each class style api object
+ * loads a new copy instead of sharing 1. glibc only supports 16 namespaces. same as dso if dlmopen is not supported
+ */
+class isolated_dso : public dso {
+public:
+    using dso::load;
+protected:
+    inline void* load(const char* name, bool test) override;
+};
+/*!
+ * a fixed number of api objects, e.g. subclasses of class style api with ::capi::isolated_dso as DLL_CLASS, then each object has a copy of the library.
+ * acquire() returns a handle of an unused object, and waits if all are in use. the object is returned to the pool when the handle is destroyed
+ */
+template<class T> class pool {
+public:
+    class handle {
+        pool* p;
+        T* obj;
+        handle(const handle&);
+        handle& operator=(const handle&);
+    public:
+        handle(pool* p, T* obj) : p(p), obj(obj) {}
+        handle(handle&& h) : p(h.p), obj(h.obj) { h.obj = nullptr;}
+        ~handle() {
+            if (obj)
+                p->release(obj);
+        }
+        T* get() const { return obj;}
+        T* operator->() const { return obj;}
+        T& operator*() const { return *obj;}
+        explicit operator bool() const { return !!obj;}
+    };
+    explicit pool(int n) : objects(n), unused(n) {
+        for (int i = 0; i < n; ++i)
+            objects[i] = unused[i] = new T();
+    }
+    ~pool() {
+        for (size_t i = 0; i < objects.size(); ++i)
+            delete objects[i];
+    }
+    int size() const { return (int)objects.size();}
+    handle acquire() {
+        ::std::unique_lock< ::std::mutex> lock(mutex);
+        cond.wait(lock, [this] { return !unused.empty();});
+        T* obj = unused.back();
+        unused.pop_back();
+        return handle(this, obj);
+    }
+    // return an empty handle if all objects are in use
+    handle tryAcquire() {
+        ::std::lock_guard< ::std::mutex> lock(mutex);
+        if (unused.empty())
+            return handle(this, nullptr);
+        T* obj = unused.back();
+        unused.pop_back();
+        return handle(this, obj);
+    }
+private:
+    void release(T* obj) {
+        {
+            ::std::lock_guard< ::std::mutex> lock(mutex);
+            unused.push_back(obj);
+        }
+        cond.notify_one();
+    }
+    ::std::vector<T*> objects;
+    ::std::vector<T*> unused;
+    ::std::mutex mutex;
+    ::std::condition_variable cond;
+};
+namespace internal {
+// pass the result of f() to done(), or call done() if f() returns void
+template<typename R> struct call_then {
+    template<class F, class D> static void run(F& f, D& done) { done(f());}
+};
+template<> struct call_then<void> {
+    template<class F, class D> static void run(F& f, D& done) { f(); done();}
+};
+} //namespace internal
+/*!
+ * worker threads running offloaded calls, e.g. blocking calls of a library from an event loop thread.
+ * instance() is the queue used by name_async() defined by CAPI_DEFINE_ASYNC. calls are run in submission order by any worker.
+ * queued calls are finished before the queue is destroyed
+ */
+class call_queue {
+public:
+    typedef ::std::function<void()> task;
+    // calls submitted together by submit(batch&) with 1 queue operation
+    class batch {
+    public:
+        template<typename F> ::std::future<decltype(::std::declval<F>()())> add(F&& f) {
+            typedef decltype(f()) R;
+            ::std::shared_ptr< ::std::packaged_task<R()>> t = ::std::make_shared< ::std::packaged_task<R()>>(::std::forward<F>(f));
+            tasks.push_back([t] { (*t)();});
+            return t->get_future();
+        }
+        // done(result) is called in a worker thread
+        template<typename F, typename D> void add(F&& f, D&& done) {
+            typedef decltype(f()) R;
+            typename ::std::decay<F>::type fn(::std::forward<F>(f));
+            typename ::std::decay<D>::type d(::std::forward<D>(done));
+            tasks.push_back([fn, d]() mutable { internal::call_then<R>::run(fn, d);});
+        }
+        size_t size() const { return tasks.size();}
+    private:
+        friend class call_queue;
+        ::std::vector<task> tasks;
+    };
+    // threads <= 0: the number of cpu cores
+    explicit call_queue(int threads = 0) : stop(false) {
+        if (threads <= 0)
+            threads = (int)::std::thread::hardware_concurrency();
+        if (threads <= 0)
+            threads = 1;
+        for (int i = 0; i < threads; ++i)
+            workers.push_back(::std::thread(&call_queue::run, this));
+    }
+    ~call_queue() {
+        {
+            ::std::lock_guard< ::std::mutex> lock(mutex);
+            stop = true;
+        }
+        cond.notify_all();
+        for (size_t i = 0; i < workers.size(); ++i)
+            workers[i].join();
+    }
+    static call_queue& instance() {
+        static call_queue q;
+        return q;
+    }
+    template<typename F> ::std::future<decltype(::std::declval<F>()())> submit(F&& f) {
+        batch b;
+        auto r = b.add(::std::forward<F>(f));
+        submit(b);
+        return r;
+    }
+    template<typename F, typename D> void submit(F&& f, D&& done) {
+        batch b;
+        b.add(::std::forward<F>(f), ::std::forward<D>(done));
+        submit(b);
+    }
+    void submit(batch& b) {
+        if (b.tasks.empty())
+            return;
+        {
+            ::std::lock_guard< ::std::mutex> lock(mutex);
+            for (size_t i = 0; i < b.tasks.size(); ++i)
+                tasks.push_back(::std::move(b.tasks[i]));
+        }
+        b.tasks.clear();
+        cond.notify_all();
+    }
+private:
+    call_queue(const call_queue&);
+    call_queue& operator=(const call_queue&);
+    void run() {
+        ::std::unique_lock< ::std::mutex> lock(mutex);
+        while (true) {
+            cond.wait(lock, [this] { return stop || !tasks.empty();});
+            if (tasks.empty())
+                return;
+            task t(::std::move(tasks.front()));
+            tasks.pop_front();
+            lock.unlock();
+            t();
+            lock.lock();
+        }
+    }
+    ::std::deque<task> tasks;
+    ::std::vector< ::std::thread> workers;
+    ::std::mutex mutex;
+    ::std::condition_variable cond;
+    bool stop;
+};
+namespace internal {
+// a namespace style dll object registered by CAPI_DEFINE_DLL for load_all()
+class dll_loader {
+public:
+    const char* const name;
+    dll_loader* next; // in registration order. a list instead of a vector, which is slow to compile in each library
+    explicit dll_loader(const char* name) : name(name), next(nullptr) {
+        ::std::lock_guard< ::std::mutex> lock(mutex());
+        dll_loader** p = &head();
+        while (*p)
+            p = &(*p)->next;
+        *p = this;
+    }
+    virtual ~dll_loader() {
+        ::std::lock_guard< ::std::mutex> lock(mutex());
+        for (dll_loader** p = &head(); *p; p = &(*p)->next) {
+            if (*p == this) {
+                *p = next;
+                break;
+            }
+        }
+    }
+    virtual bool load(bool resolve) = 0;
+    static ::std::mutex& mutex() {
+        static ::std::mutex m;
+        return m;
+    }
+    static dll_loader*& head() {
+        static dll_loader* h = nullptr;
+        return h;
+    }
+    // (name, dependency) pairs added by load_after()
+    static ::std::vector< ::std::pair<const char*, const char*>>& dependencies() {
+        static ::std::vector< ::std::pair<const char*, const char*>> d;
+        return d;
+    }
+};
+} //namespace internal
+struct load_result {
+    const char* name; // the first library name of a dll
+    bool loaded;
+    int64_t us; // load time in microseconds, including resolving all symbols if required
 };
+/*!
+ * name is loaded by load_all() after dependency is loaded. names are the first library names of CAPI_BEGIN_DLL*(names, ...), e.g. load_after("avcodec", "avutil")
+ */
+inline void load_after(const char* name, const char* dependency) {
+    ::std::lock_guard< ::std::mutex> lock(internal::dll_loader::mutex());
+    internal::dll_loader::dependencies().push_back(::std::make_pair(name, dependency));
+}
+/*!
+ * load all namespace style dll objects defined by CAPI_DEFINE_DLL in parallel, in threads worker threads (<= 0: cpu cores),
+ * and resolve all symbols if resolve is true. a dll is loaded after its dependencies(load_after()) are finished. dependencies between dlls in a cycle are ignored, but a dll depending on a dll in a cycle still waits for it.
+ * return when all are finished, in registration order
+ */
+inline ::std::vector<load_result> load_all(bool resolve = false, int threads = 0) {
+    ::std::vector<internal::dll_loader*> dlls;
+    ::std::vector< ::std::pair<const char*, const char*>> deps;
+    {
+        ::std::lock_guard< ::std::mutex> lock(internal::dll_loader::mutex());
+        int count = 0;
+        for (internal::dll_loader* d = internal::dll_loader::head(); d; d = d->next)
+            ++count;
+        dlls.resize(count);
+        count = 0;
+        for (internal::dll_loader* d = internal::dll_loader::head(); d; d = d->next)
+            dlls[count++] = d;
+        deps = internal::dll_loader::dependencies();
+    }
+    const int n = (int)dlls.size();
+    ::std::vector<load_result> results(n);
+    if (n == 0)
+        return results;
+    ::std::vector<int> waits(n); // the number of unfinished dependencies
+    ::std::vector< ::std::vector<int>> dependents(n);
+    for (size_t k = 0; k < deps.size(); ++k) {
+        for (int i = 0; i < n; ++i) {
+            if (strcmp(dlls[i]->name, deps[k].first))
+                continue;
+            for (int j = 0; j < n; ++j) {
+                if (j == i || strcmp(dlls[j]->name, deps[k].second))
+                    continue;
+                dependents[j].push_back(i);
+                ++waits[i];
+            }
+        }
+    }
+    // break cycles: an edge j->i is in a cycle if j is reachable from i, i.e. both are in a strongly connected component.
+    // only such edges are ignored, so dlls depending on a cycle still wait for it
+    ::std::vector< ::std::vector<bool>> reach(n, ::std::vector<bool>(n)); // reach[a][b]: b waits for a directly or indirectly
+    for (int a = 0; a < n; ++a) {
+        ::std::vector<int> todo(1, a);
+        while (!todo.empty()) {
+            const int x = todo.back();
+            todo.pop_back();
+            for (size_t d = 0; d < dependents[x].size(); ++d) {
+                const int y = dependents[x][d];
+                if (!reach[a][y]) {
+                    reach[a][y] = true;
+                    todo.push_back(y);
+                }
+            }
+        }
+    }
+    for (int j = 0; j < n; ++j) {
+        ::std::vector<int>& dep = dependents[j];
+        for (size_t d = 0; d < dep.size();) {
+            if (reach[dep[d]][j]) {
+                --waits[dep[d]];
+                dep.erase(dep.begin() + d);
+            } else {
+                ++d;
+            }
+        }
+    }
+    ::std::mutex mutex;
+    ::std::condition_variable cond;
+    int finished = 0;
+    call_queue q(threads > 0 ? threads : ::std::min<int>(n, (int)::std::max(1u, ::std::thread::hardware_concurrency())));
+    ::std::function<void(int)> start = [&](int i) {
+        q.submit([&, i] { // no future, it's slow to compile in each library
+            const ::std::chrono::steady_clock::time_point t0 = ::std::chrono::steady_clock::now();
+            load_result r;
+            r.name = dlls[i]->name;
+            r.loaded = dlls[i]->load(resolve);
+            r.us = ::std::chrono::duration_cast< ::std::chrono::microseconds>(::std::chrono::steady_clock::now() - t0).count();
+            return r;
+        }, [&, i](const load_result& r) {
+            ::std::vector<int> ready;
+            {
+                ::std::lock_guard< ::std::mutex> lock(mutex);
+                results[i] = r;
+                for (size_t d = 0; d < dependents[i].size(); ++d) {
+                    if (--waits[dependents[i][d]] == 0)
+                        ready.push_back(dependents[i][d]);
+                }
+            }
+            for (size_t k = 0; k < ready.size(); ++k)
+                start(ready[k]);
+            ::std::lock_guard< ::std::mutex> lock(mutex);
+            if (++finished == n)
+                cond.notify_all();
+        });
+    };
+    ::std::vector<int> ready; // before any is started and finished
+    for (int i = 0; i < n; ++i) {
+        if (!waits[i])
+            ready.push_back(i);
+    }
+    for (size_t r = 0; r < ready.size(); ++r)
+        start(ready[r]);
+    ::std::unique_lock< ::std::mutex> lock(mutex);
+    cond.wait(lock, [&] { return finished == n;});
+    return results;
+}
 } //namespace capi
 /// DLL_CLASS is a library loader and symbols resolver class. Must implement api like capi::dso (the same function name and return type, but string parameter type can be different):
 /// unload() must support ref count. i.e. do unload if no one is using the real library
 /// Currently you can use ::capi::dso and QLibrary for DLL_CLASS. You can also use your own library resolver
 #define CAPI_BEGIN_DLL(names, DLL_CLASS) \
     class api_dll : public ::capi::internal::dll_helper<DLL_CLASS> { \
-    public: api_dll() : ::capi::internal::dll_helper<DLL_CLASS>(names) CAPI_DLL_BODY_DEFINE
+    public: static const char* libraryName() { return names[0];} \
+    api_dll(bool test = false, const char* path = nullptr) : ::capi::internal::dll_helper<DLL_CLASS>(names, ::capi::internal::kDefaultVersions, test, 0, path) CAPI_DLL_BODY_DEFINE
 #define CAPI_BEGIN_DLL_VER(names, versions, DLL_CLASS) \
     class api_dll : public ::capi::internal::dll_helper<DLL_CLASS> { \
-    public: api_dll(bool test = false) : ::capi::internal::dll_helper<DLL_CLASS>(names, versions, test) CAPI_DLL_BODY_DEFINE
-#if CAPI_IS(LAZY_RESOLVE)
-#define CAPI_END_DLL() } api_t; api_t api; };
+    public: static const char* libraryName() { return names[0];} \
+    api_dll(bool test = false, const char* path = nullptr) : ::capi::internal::dll_helper<DLL_CLASS>(names, versions, test, 0, path) CAPI_DLL_BODY_DEFINE
+/// flags: ::capi::LoadNow etc., used if DLL_CLASS has setLoadFlags(int) like ::capi::dso
+#define CAPI_BEGIN_DLL_FLAGS(names, versions, flags, DLL_CLASS) \
+    class api_dll : public ::capi::internal::dll_helper<DLL_CLASS> { \
+    public: static const char* libraryName() { return names[0];} \
+    api_dll(bool test = false, const char* path = nullptr) : ::capi::internal::dll_helper<DLL_CLASS>(names, versions, test, flags, path) CAPI_DLL_BODY_DEFINE
+#if CAPI_IS(TRAMPOLINE)
+#define CAPI_END_DLL() CAPI_END_TABLE static api_t api; \
+    static_assert(!::std::is_base_of< ::capi::isolated_dso, dll_type>::value, "CAPI_IS_TRAMPOLINE does not support ::capi::isolated_dso, entries are shared by all copies"); };
 #else
-#define CAPI_END_DLL() };
+/*
+ * api is not in the same cache line of dll_helper members.
+ * it's a variant member, so entry initializers are not run one by one, the constructor zeros it by memset. 1 store per entry is slow to compile for a large library
+ */
+#define CAPI_END_DLL() CAPI_END_TABLE union { alignas(64) api_t api;}; };
 #endif
-#define CAPI_DEFINE_DLL api::api():dll(new api_dll()){} \
-    api::~api(){delete dll;} \
+#define CAPI_DEFINE_DLL api::api():dll(::capi::internal::registry<api_dll>::acquire()){} \
+    api::~api(){ ::capi::internal::registry<api_dll>::release(dll);} \
     bool api::loaded() const { return dll->isLoaded();} \
+    CAPI_DEFINE_NS_DLL
+// namespace style only, e.g. no class api is declared for ::capi::function
+#define CAPI_DEFINE_NS_DLL \
     namespace capi { \
-        static api_dll* dll = NULL; \
+        static ::std::atomic<api_dll*> dll(nullptr); \
+        static api_dll* dll_instance() { return ::capi::internal::instance(dll);} \
         bool loaded() { \
-            if (!dll) dll = new api_dll(); \
+            CAPI_NS_DLL_INSTANCE; \
             return dll->isLoaded(); \
         } \
-    }
+        ::std::shared_future<bool> preload(bool resolve) { return ::capi::internal::preload(dll, resolve);} \
+        CAPI_DEFINE_RELOAD \
+        CAPI_DEFINE_PROFILE_SAVER \
+        static ::capi::internal::ns_dll_loader<api_dll> dll_loader(dll); \
+    } \
+    api_dll* api_dll::instance() { return capi::dll_instance();} \
+    CAPI_DEFINE_DLL_TRAMPOLINE
 
 /*!
  * N: number of arguments
@@ -132,42 +714,208 @@ protected:
  */
 #if CAPI_IS(LAZY_RESOLVE)
 #define CAPI_DEFINE(R, name, ...) CAPI_EXPAND(CAPI_DEFINE2_X(R, name, name, __VA_ARGS__)) /* not ##__VA_ARGS__ !*/
-#define CAPI_DEFINE_ENTRY(R, name, ...) CAPI_EXPAND(CAPI_DEFINE_ENTRY_X(R, name, name, __VA_ARGS__))
-#define CAPI_DEFINE_M_ENTRY(R, M, name, ...) CAPI_EXPAND(CAPI_DEFINE_M_ENTRY_X(R, M, name, name, __VA_ARGS__))
 #else
 #define CAPI_DEFINE(R, name, ...) CAPI_EXPAND(CAPI_DEFINE_X(R, name, __VA_ARGS__)) /* not ##__VA_ARGS__ !*/
-#define CAPI_DEFINE_ENTRY(R, name, ...) CAPI_EXPAND(CAPI_DEFINE_RESOLVER_X(R, name, name, __VA_ARGS__))
-#define CAPI_DEFINE_M_ENTRY(R, M, name, ...) CAPI_EXPAND(CAPI_DEFINE_M_RESOLVER_X(R, M, name, name, __VA_ARGS__))
 #endif
+#define CAPI_DEFINE_ENTRY(R, name, ...) CAPI_EXPAND(CAPI_DEFINE_ENTRY_X(R, name, name, __VA_ARGS__))
+#define CAPI_DEFINE_M_ENTRY(R, M, name, ...) CAPI_EXPAND(CAPI_DEFINE_M_ENTRY_X(R, M, name, name, __VA_ARGS__))
+/*!
+ * hot entries are resolved in 1 pass when the library is loaded even in lazy mode, wherever they are declared.
+ * declare them before other entries to pack them at the beginning of the 64 byte aligned api_t
+ */
+#define CAPI_DEFINE_HOT_ENTRY(R, name, ...) CAPI_EXPAND(CAPI_DEFINE_M_ENTRY_HOT_X(R, EMPTY_LINKAGE, name, name, true, __VA_ARGS__))
+#define CAPI_DEFINE_HOT_M_ENTRY(R, M, name, ...) CAPI_EXPAND(CAPI_DEFINE_M_ENTRY_HOT_X(R, M, name, name, true, __VA_ARGS__))
+/*!
+ * an entry of the symbol of version ver(a string, e.g. "ZLIB_1.2.9"), resolved by dlvsym. falls back to the default version by dlsym.
+ * whether it's resolved is reported by available entries(CAPI_DEFINE_HAS) instead of asserts, e.g.
+ *   CAPI_DEFINE_VER_ENTRY(int, inflateReset2, "ZLIB_1.2.3.4", CAPI_ARG2(z_streamp, int))
+ */
+#define CAPI_DEFINE_VER_ENTRY(R, name, ver, ...) CAPI_EXPAND(CAPI_DEFINE_M_ENTRY_HOT_S(R, EMPTY_LINKAGE, name, #name "@" ver, false, __VA_ARGS__))
+#define CAPI_DEFINE_VER_M_ENTRY(R, M, name, ver, ...) CAPI_EXPAND(CAPI_DEFINE_M_ENTRY_HOT_S(R, M, name, #name "@" ver, false, __VA_ARGS__))
+/*!
+ * CAPI_ENTRY_INDEX(name): index of an entry in api_t, i.e. the bit index in dll->availableEntries(). it's a constant expression, so per entry data can be flat arrays of api_dll::entry_count.
+ * api_dll::entryIndex("name") is the same index of a runtime name(e.g. from a config), by a perfect hash built once from compile time hashes of all entries. no string compare
+ * CAPI_DEFINE_HAS(name): define bool api::has_name() const and capi::has_name() to test whether the symbol is available.
+ * in lazy mode the first query looks up all symbols in 1 pass without resolving the entries, then it's a bit test. declare them in the header like CAPI_DEFINE
+ */
+#define CAPI_ENTRY_INDEX(name) (int)(offsetof(api_dll::api_t, name)/sizeof(void*))
+#define CAPI_DEFINE_HAS(name) \
+    bool api::has_##name() const { return dll->isAvailable(CAPI_ENTRY_INDEX(name));} \
+    namespace capi { \
+        bool has_##name() { \
+            CAPI_NS_DLL_INSTANCE; \
+            return dll->isAvailable(CAPI_ENTRY_INDEX(name)); \
+        } \
+    }
 //CAPI_EXPAND(CAPI_DEFINE##N(R, name, #name, __VA_ARGS__))
 
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 /************The followings are used internally**********/
+/*
+ * entries are declared in class template table<P>. table<lazy_table>, table<eager_table> or table<trampoline_table> is the function pointer table api_t,
+ * and table<symbol_table> is the symbol name table of the same layout, so all symbols can be resolved in 1 pass.
+ * table<hot_table> is a char array, 1 for a hot entry
+ */
+#if CAPI_IS(TRAMPOLINE)
+#define CAPI_DLL_BODY_DEFINE { CAPI_RESOLVE_HOT CAPI_WARM_UP} template<class P> struct table {
+#define CAPI_DEFINE_DLL_TRAMPOLINE alignas(64) api_dll::api_t api_dll::api;
+#elif CAPI_IS(LAZY_RESOLVE)
+#define CAPI_DLL_BODY_DEFINE { memset(static_cast<void*>(&api), 0, sizeof(api)); CAPI_RESOLVE_HOT CAPI_WARM_UP} template<class P> struct table {
+#else
+#define CAPI_DLL_BODY_DEFINE { \
+        memset(static_cast<void*>(&api), 0, sizeof(api)); \
+        if (!isLoaded()) { \
+            CAPI_WARN_LOAD("dll not loaded"); \
+            return; \
+        } \
+        const int n = resolve(symbols(), reinterpret_cast<void**>(&api), entry_count); \
+        CAPI_DBG_RESOLVE("capi resolved %d/%d dll symbols", n, (int)entry_count); \
+        (void)n; \
+        resolveAll(); \
+    } template<class P> struct table {
+#endif
+#if CAPI_IS(LAZY_RESOLVE)
+#if CAPI_IS(TRAMPOLINE)
+#define CAPI_TABLE_POLICY ::capi::internal::trampoline_table
+#else
+#define CAPI_TABLE_POLICY ::capi::internal::lazy_table
+#endif
+#define CAPI_RESOLVE_HOT \
+    if (isLoaded()) \
+        ::capi::internal::resolve_hot(*this, api, symbols(), hotEntries(), entry_count);
+#else
+#define CAPI_TABLE_POLICY ::capi::internal::eager_table
+#define CAPI_RESOLVE_HOT
+#endif
+#define CAPI_END_TABLE }; \
+    typedef table<CAPI_TABLE_POLICY> api_t; \
+    static api_dll* instance(); /* the namespace style dll object */ \
+    enum { entry_count = sizeof(table< ::capi::internal::symbol_table>)/sizeof(const char*) }; \
+    static const char* const* symbols() { \
+        static_assert(entry_count == 0 || sizeof(api_t) == entry_count*sizeof(void*), "api_t must be an array of function pointers"); \
+        static constexpr table< ::capi::internal::symbol_table> t{}; \
+        return reinterpret_cast<const char* const*>(&t); \
+    } \
+    /* compile time symbol_hash() of each entry. templates, so the hashes are evaluated only if entryIndex() is used */ \
+    template<int = 0> static const uint64_t* symbolHashes() { \
+        static_assert(sizeof(table< ::capi::internal::hash_table>) == entry_count*sizeof(uint64_t) || entry_count == 0, "hash_table must be an uint64_t array"); \
+        static constexpr table< ::capi::internal::hash_table> t{}; \
+        return reinterpret_cast<const uint64_t*>(&t); \
+    } \
+    /* index of the entry of symbol sym("name" or "name@VERSION") by a perfect hash, i.e. CAPI_ENTRY_INDEX(name), or -1 if not found */ \
+    template<int = 0> static int entryIndex(const char* sym) { \
+        static const ::capi::internal::perfect_hash h(symbolHashes(), entry_count); \
+        return h.find(::capi::internal::symbol_hash(sym)); \
+    } \
+    static const char* hotEntries() { \
+        static_assert(sizeof(table< ::capi::internal::hot_table>) == entry_count || entry_count == 0, "hot_table must be a char array"); \
+        static constexpr table< ::capi::internal::hot_table> t{}; \
+        return reinterpret_cast<const char*>(&t); \
+    } \
+    static void* operator new(size_t size) { return ::capi::internal::aligned_alloc(size);} \
+    static void operator delete(void* p) { ::capi::internal::aligned_free(p);} \
+    CAPI_RESOLVE_ALL_DEFINE \
+    CAPI_PROFILE_DEFINE
+#if CAPI_IS(PROFILE_RESOLVE)
+#define CAPI_WARM_UP \
+    if (isLoaded()) \
+        warmup = ::std::async(::std::launch::async, [this] { return ::capi::internal::warm_up(*this, api, symbols(), entry_count);});
+#define CAPI_PROFILE_DEFINE \
+    ::std::future<int> warmup; \
+    ~api_dll() { saveProfile();} \
+    void saveProfile() { \
+        if (warmup.valid()) \
+            warmup.wait(); \
+        ::capi::internal::save_profile(api, symbols(), entry_count); \
+    }
+#define CAPI_DEFINE_PROFILE_SAVER static ::capi::internal::profile_saver<api_dll> dll_profile_saver(dll);
+#else
+#define CAPI_WARM_UP
+#define CAPI_PROFILE_DEFINE
+#define CAPI_DEFINE_PROFILE_SAVER
+#endif
+#if CAPI_IS(RELOAD)
+/*!
+ * load the library from path(or names and versions of CAPI_BEGIN_DLL* if null) in a new dll object, resolve all symbols and publish it to namespace style calls.
+ * the old dll object is released after calls using it return. must not be called in a callback from the library.
+ * return false and keep the current one if failed to load, or the loaded library is the current one, e.g. dlopen() of a loaded path even if the file is replaced.
+ * declare it as bool reload(const char* path = nullptr);
+ */
+#define CAPI_DEFINE_RELOAD bool reload(const char* path) { return ::capi::internal::reload(dll, path);}
+#define CAPI_NS_DLL_INSTANCE ::capi::internal::hazard_guard<api_dll> dll_guard(dll); api_dll* dll = dll_guard.get()
+#else
+#define CAPI_DEFINE_RELOAD
+#define CAPI_NS_DLL_INSTANCE api_dll* dll = dll_instance()
+#endif
+#if CAPI_IS(STATS)
+#define CAPI_STATS_CALL(name) ::capi::internal::call_scope capi_call_scope(::capi::internal::call_stats<api_dll>::local()[CAPI_ENTRY_INDEX(name)])
+#else
+#define CAPI_STATS_CALL(name)
+#endif
 #if CAPI_IS(LAZY_RESOLVE)
-#define CAPI_DLL_BODY_DEFINE { memset(&api, 0, sizeof(api));} typedef struct api_t {
+#define CAPI_RESOLVE_ALL(available) ::capi::internal::resolve_all(*this, api, symbols(), entry_count, available)
+#define CAPI_FIND_ALL(available) ::capi::internal::find_all(*this, symbols(), entry_count, available)
 #else
-#define CAPI_DLL_BODY_DEFINE { CAPI_DBG_RESOLVE("capi resolved dll symbols...");}
+#define CAPI_RESOLVE_ALL(available) ::capi::internal::count_resolved(api, entry_count, available)
+#define CAPI_FIND_ALL(available) CAPI_RESOLVE_ALL(available)
+#endif
+/*!
+ * available entries are a bitmap of entry_count bits in declaration order, bit i is set if entry i is resolved.
+ * it's filled by resolveAll(), which is called in constructor in eager mode and by preload(true) in lazy mode.
+ * otherwise the first query in lazy mode looks up all symbols in 1 pass, but entries are not published, so they are still resolved by the first calls
+ */
+#define CAPI_RESOLVE_ALL_DEFINE \
+    ::std::atomic<uint64_t> available[entry_count/64 + 1]; \
+    ::std::atomic<bool> available_ready{false}; \
+    int resolveAll() { \
+        const int n = CAPI_RESOLVE_ALL(available); \
+        available_ready.store(true, ::std::memory_order_release); \
+        return n; \
+    } \
+    const ::std::atomic<uint64_t>* availableEntries() { \
+        if (!available_ready.load(::std::memory_order_acquire)) { \
+            CAPI_FIND_ALL(available); \
+            available_ready.store(true, ::std::memory_order_release); \
+        } \
+        return available; \
+    } \
+    bool isAvailable(int index) { return !!((availableEntries()[index/64].load(::std::memory_order_relaxed) >> (index%64)) & 1);}
+#ifndef CAPI_DEFINE_DLL_TRAMPOLINE
+#define CAPI_DEFINE_DLL_TRAMPOLINE
 #endif
 #define CAPI_DEFINE_T_V(R, name, ARG_T, ARG_T_V, ARG_V) \
     R api::name ARG_T_V { \
         CAPI_DBG_CALL(" "); \
+        CAPI_STATS_CALL(name); \
+        CAPI_TRACE_CALL(name); \
         assert(dll && dll->isLoaded() && "dll is not loaded"); \
-        return dll->name ARG_V; \
+        return dll->api.name ARG_V; \
+    }
+#if CAPI_IS(TRAMPOLINE)
+#define CAPI_DEFINE2_T_V(R, name, sym, ARG_T, ARG_T_V, ARG_V) \
+    R api::name ARG_T_V { \
+        CAPI_DBG_CALL(" "); \
+        CAPI_STATS_CALL(name); \
+        CAPI_TRACE_CALL(name); \
+        return api_dll::api.name.load(::std::memory_order_acquire) ARG_V; \
     }
+#else
 #define CAPI_DEFINE2_T_V(R, name, sym, ARG_T, ARG_T_V, ARG_V) \
     R api::name ARG_T_V { \
         CAPI_DBG_CALL(" "); \
+        CAPI_STATS_CALL(name); \
+        CAPI_TRACE_CALL(name); \
         assert(dll && dll->isLoaded() && "dll is not loaded"); \
-        if (!dll->api.name) { \
-            dll->api.name = (api_dll::api_t::name##_t)dll->resolve(#sym); \
-            CAPI_DBG_RESOLVE("dll::api_t::" #name ": @%p", dll->api.name); \
-        } \
-        assert(dll->api.name && "failed to resolve " #R #sym #ARG_T_V); \
-        return dll->api.name ARG_V; \
+        api_dll::api_t::name##_t f = (api_dll::api_t::name##_t)dll->api.name.load(::std::memory_order_acquire); \
+        if (!f) \
+            f = (api_dll::api_t::name##_t)::capi::internal::resolve_entry(dll, CAPI_ENTRY_INDEX(name)); \
+        assert(f && "failed to resolve " #R #sym #ARG_T_V); \
+        return f ARG_V; \
     }
+#endif //CAPI_IS(TRAMPOLINE)
 /*
  * TODO: choose 1 of below
- * - use CAPI_LINKAGE and remove CAPI_DEFINE_M_ENTRY_X & CAPI_DEFINE_M_RESOLVER_X
+ * - use CAPI_LINKAGE and remove CAPI_DEFINE_M_ENTRY_X
  * - also pass a linkage parameter to CAPI_NS_DEFINE_T_V & CAPI_NS_DEFINE2_T_V
  */
 #ifndef CAPI_LINKAGE
@@ -175,48 +923,39 @@ protected:
 #endif //CAPI_LINKAGE
 #define CAPI_NS_DEFINE_T_V(R, name, ARG_T, ARG_T_V, ARG_V) \
     namespace capi { \
-    using capi::dll; \
     R CAPI_LINKAGE name ARG_T_V { \
         CAPI_DBG_CALL(" "); \
-        if (!dll) dll = new api_dll(); \
+        CAPI_STATS_CALL(name); \
+        CAPI_TRACE_CALL(name); \
+        CAPI_NS_DLL_INSTANCE; \
         assert(dll && dll->isLoaded() && "dll is not loaded"); \
-        return dll->name ARG_V; \
+        return dll->api.name ARG_V; \
+    } }
+#if CAPI_IS(TRAMPOLINE)
+#define CAPI_NS_DEFINE2_T_V(R, name, sym, ARG_T, ARG_T_V, ARG_V) \
+    namespace capi { \
+    R CAPI_LINKAGE name ARG_T_V { \
+        CAPI_DBG_CALL(" "); \
+        CAPI_STATS_CALL(name); \
+        CAPI_TRACE_CALL(name); \
+        return api_dll::api.name.load(::std::memory_order_acquire) ARG_V; \
     } }
+#else
 #define CAPI_NS_DEFINE2_T_V(R, name, sym, ARG_T, ARG_T_V, ARG_V) \
     namespace capi { \
-    using capi::dll; \
     R CAPI_LINKAGE name ARG_T_V { \
         CAPI_DBG_CALL(" "); \
-        if (!dll) dll = new api_dll(); \
+        CAPI_STATS_CALL(name); \
+        CAPI_TRACE_CALL(name); \
+        CAPI_NS_DLL_INSTANCE; \
         assert(dll && dll->isLoaded() && "dll is not loaded"); \
-        if (!dll->api.name) { \
-            dll->api.name = (api_dll::api_t::name##_t)dll->resolve(#sym); \
-            CAPI_DBG_RESOLVE("dll::api_t::" #name ": @%p", dll->api.name); \
-        } \
-        assert(dll->api.name && "failed to resolve " #R #sym #ARG_T_V); \
-        return dll->api.name ARG_V; \
+        api_dll::api_t::name##_t f = (api_dll::api_t::name##_t)dll->api.name.load(::std::memory_order_acquire); \
+        if (!f) \
+            f = (api_dll::api_t::name##_t)::capi::internal::resolve_entry(dll, CAPI_ENTRY_INDEX(name)); \
+        assert(f && "failed to resolve " #R #sym #ARG_T_V); \
+        return f ARG_V; \
     } }
-
-// nested class can not call non-static members outside the class, so hack the address here
-#define CAPI_DEFINE_M_RESOLVER_T_V(R, M, name, sym, ARG_T, ARG_T_V, ARG_V) \
-    public: \
-        typedef R (M *name##_t) ARG_T; \
-        name##_t name; \
-    private: \
-        struct name##_resolver_t { \
-            name##_resolver_t() { \
-                name##_t *p = (name##_t*)((intptr_t)this - (offsetof(name##_resolver, api_dll) - offsetof(name, api_dll))); \
-                api_dll* dll = (api_dll*)((intptr_t)this - offsetof(name##_resolver, api_dll)); \
-                if (!dll->isLoaded()) { \
-                    CAPI_WARN_LOAD("dll not loaded"); \
-                    *p = NULL; \
-                    return; \
-                } \
-                *p = (name##_t)dll->resolve(#sym); \
-                if (*p) { CAPI_DBG_RESOLVE("dll::" #name ": @%p", *p); } \
-                else { CAPI_WARN_RESOLVE("capi resolve error '" #name "'"); } \
-            } \
-        } name##_resolver;
+#endif //CAPI_IS(TRAMPOLINE)
 
 #if defined(_WIN32) // http://nadeausoftware.com/articles/2012/01/c_c_tip_how_use_compiler_predefined_macros_detect_operating_system
 # define CAPI_TARGET_OS_WIN 1
@@ -229,6 +968,10 @@ protected:
 # endif //WINAPI_FAMILY
 #else
 # include <dlfcn.h>
+# include <fcntl.h>
+# include <unistd.h>
+# include <sys/mman.h>
+# include <sys/stat.h>
 _Pragma("weak dladdr") // dladdr is not always supported
 #endif
 #if (__MACH__+0)
@@ -286,8 +1029,20 @@ extern "C" int dl_iterate_phdr(int (*__callback)(struct dl_phdr_info*, size_t, v
 #define CAPI_DBG_CALL(...)
 #define CAPI_WARN_CALL(...)
 #endif //DEBUG_CALL
+#if CAPI_IS(TRACE)
+#define CAPI_TRACE(type, name, handle, result) ::capi::internal::trace_event(::capi::trace::type, name, handle, (intptr_t)(result))
+#define CAPI_TRACE_CALL(name) CAPI_TRACE(Call, #name, nullptr, 0)
+#else
+#define CAPI_TRACE(...)
+#define CAPI_TRACE_CALL(name)
+#endif //CAPI_IS(TRACE)
 //fully expand. used by VC. VC will not expand __VA_ARGS__ but treats it as 1 parameter
 #define CAPI_EXPAND(expr) expr
+#ifdef CAPI_TARGET_OS_WIN
+#define CAPI_SNPRINTF _snprintf
+#else
+#define CAPI_SNPRINTF snprintf
+#endif
 namespace capi {
 namespace internal {
 // the following code is for the case DLL=QLibrary + QT_NO_CAST_FROM_ASCII
@@ -306,92 +1061,1285 @@ template<> struct dso_trait<QLibrary> {
     typedef QString qstr_t;
 };
 #endif
-// base ctor dll_helper("name")=>derived members in decl order(resolvers)=>derived ctor
-static const int kDefaultVersions[] = {::capi::NoVersion, ::capi::EndVersion};
-template <class DLL> class dll_helper { //no CAPI_EXPORT required
-    DLL m_lib;
-    typename dso_trait<DLL>::str_t strType(const char* s) {
-        return dso_trait<DLL>::qstr_t::fromLatin1(s);
+// api_dll::table<P> policies. P::entry<F> is the type of an entry whose function pointer type is F, P::init(sym, hot, stub) is the initial value.
+// alias templates and init() of 1 instantiation are used, so a large table does not instantiate templates for each entry
+struct symbol_table {
+    template<typename F> using entry = const char*;
+    template<typename F = int> static constexpr const char* init(const char* sym, bool = false, F = F()) { return sym;}
+};
+struct hot_table {
+    template<typename F> using entry = char;
+    template<typename F = int> static constexpr char init(const char*, bool hot = false, F = F()) { return hot;}
+};
+// entries are not initialized in api_dll constructor, see CAPI_END_DLL. 1 atomic type for all entries, a wrapper casts the loaded pointer
+struct lazy_table {
+    template<typename F> using entry = ::std::atomic<void*>;
+    template<typename F = int> static constexpr ::std::nullptr_t init(const char*, bool = false, F = F()) { return nullptr;}
+};
+struct eager_table {
+    template<typename F> using entry = F;
+    template<typename F = int> static constexpr ::std::nullptr_t init(const char*, bool = false, F = F()) { return nullptr;}
+};
+// static table of self patching entries, initialized by stubs
+struct trampoline_table {
+    template<typename F> using entry = ::std::atomic<F>;
+    template<typename F> static constexpr F init(const char*, bool, F stub) { return stub;}
+};
+// 64 bit FNV-1a of a symbol name, without "@VERSION"
+constexpr uint64_t symbol_hash(const char* s, uint64_t h = 14695981039346656037ULL) {
+    return (*s && *s != '@') ? symbol_hash(s + 1, (h ^ (uint8_t)*s) * 1099511628211ULL) : h;
+}
+struct hash_table {
+    template<typename F> using entry = uint64_t;
+    template<typename F = int> static constexpr uint64_t init(const char* sym, bool = false, F = F()) { return symbol_hash(sym);}
+};
+/*!
+ * a minimal perfect hash from symbol hashes of a table<hash_table> to entry indices by hash and displace.
+ * keys are grouped in buckets, and a displacement of each bucket is searched to put all keys in distinct slots. find() is 1 slot probe and 1 hash compare
+ */
+class perfect_hash {
+    ::std::vector<uint32_t> disp; // displacement of each bucket
+    ::std::vector<int> slots; // entry index, -1 if empty
+    const uint64_t* hashes;
+    static uint64_t mix(uint64_t h) { // splitmix64 finalizer
+        h = (h ^ (h >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        h = (h ^ (h >> 27)) * 0x94d049bb133111ebULL;
+        return h ^ (h >> 31);
     }
+    size_t bucket(uint64_t h) const { return size_t(h >> 32) % disp.size();}
+    size_t slot(uint64_t h, uint32_t d) const { return size_t(mix(h + d)) & (slots.size() - 1);}
 public:
-    dll_helper(const char* names[], const int versions[] = kDefaultVersions, bool test = false) {
-        static bool is_1st = true;
-        if (is_1st) {
-            is_1st = false;
-            fprintf(stderr, "capi::version: %s\n", ::capi::version::name);
+    perfect_hash(const uint64_t* hashes, int n) : disp(n/4 + 1), hashes(hashes) {
+        size_t size = 2;
+        while (size < 2*size_t(n)) // load factor <= 0.5
+            size *= 2;
+        slots.assign(size, -1);
+        ::std::vector< ::std::vector<int>> buckets(disp.size());
+        for (int i = 0; i < n; ++i) {
+            ::std::vector<int>& b = buckets[bucket(hashes[i])];
+            bool dup = false; // the same symbol in multiple entries. the 1st one is used
+            for (size_t k = 0; k < b.size() && !dup; ++k)
+                dup = hashes[b[k]] == hashes[i];
+            if (!dup)
+                b.push_back(i);
         }
-        for (int i = 0; names[i]; ++i) {
-            for (int j = 0; versions[j] != ::capi::EndVersion; ++j) {
-                if (versions[j] == ::capi::NoVersion)
-                    m_lib.setFileName(strType(names[i]));
-                else
-                    m_lib.setFileNameAndVersion(strType(names[i]), versions[j]);
-                if (m_lib.load(test)) {
-                    CAPI_DBG_LOAD("capi loaded {library name: %s, version: %d}: %s, test: %d", names[i], versions[j], m_lib.path(), test);
-                    return;
+        ::std::vector<size_t> order(buckets.size());
+        for (size_t i = 0; i < order.size(); ++i)
+            order[i] = i;
+        ::std::sort(order.begin(), order.end(), [&buckets](size_t a, size_t b) { return buckets[a].size() > buckets[b].size();});
+        ::std::vector<size_t> taken;
+        for (size_t i = 0; i < order.size() && !buckets[order[i]].empty(); ++i) {
+            const ::std::vector<int>& b = buckets[order[i]];
+            for (uint32_t d = 0; ; ++d) {
+                taken.clear();
+                for (size_t k = 0; k < b.size(); ++k) {
+                    const size_t s = slot(hashes[b[k]], d);
+                    if (slots[s] >= 0 || ::std::find(taken.begin(), taken.end(), s) != taken.end())
+                        break;
+                    taken.push_back(s);
                 }
-                CAPI_WARN_LOAD("capi can not load {library name: %s, version %d, test: %d}", names[i], versions[j], test);
+                if (taken.size() < b.size())
+                    continue;
+                for (size_t k = 0; k < b.size(); ++k)
+                    slots[taken[k]] = b[k];
+                disp[order[i]] = d;
+                break;
             }
         }
     }
-    virtual ~dll_helper() { m_lib.unload();}
-    bool isLoaded() const { return m_lib.isLoaded(); }
-    void* resolve(const char *symbol) { return (void*)m_lib.resolve(symbol);}
+    // entry index of symbol hash h, or -1
+    int find(uint64_t h) const {
+        const int i = slots[slot(h, disp[bucket(h)])];
+        return i >= 0 && hashes[i] == h ? i : -1;
+    }
 };
-#ifdef CAPI_TARGET_OS_WIN
-    static const char kPre[] = "";
-    static const char kExt[] = ".dll";
-#else
-    static const char kPre[] = "lib";
-#ifdef CAPI_TARGET_OS_MAC
-    static const char kExt[] = ".dylib";
-#else
-    static const char kExt[] = ".so";
-#endif
-#endif
-} //namespace internal
-#ifdef CAPI_TARGET_OS_WIN
-#define CAPI_SNPRINTF _snprintf
-#else
-#define CAPI_SNPRINTF snprintf
-#endif
-void dso::setFileName(const char* name) {
-    CAPI_DBG_LOAD("dso.setFileName(\"%s\")", name);
-    if (name[0] == '/')
-        CAPI_SNPRINTF(full_name, sizeof(full_name), "%s", name);
-    else
-        CAPI_SNPRINTF(full_name, sizeof(full_name), "%s%s%s", internal::kPre, name, internal::kExt);
+// api_dll is allocated by new, and alignas(64) api_t is not respected by new before c++17
+inline void* aligned_alloc(size_t size) {
+    void* p = malloc(size + 64);
+    if (!p)
+        throw ::std::bad_alloc();
+    void* a = reinterpret_cast<void*>((reinterpret_cast<uintptr_t>(p) + 64) & ~uintptr_t(63));
+    reinterpret_cast<void**>(a)[-1] = p;
+    return a;
 }
-void dso::setFileNameAndVersion(const char* name, int ver) {
-    CAPI_DBG_LOAD("dso.setFileNameAndVersion(\"%s\", %d)", name, ver);
-    if (ver >= 0) {
-#if defined(CAPI_TARGET_OS_WIN) // ignore version on win. xxx-V.dll?
-        CAPI_SNPRINTF(full_name, sizeof(full_name), "%s%s%s", internal::kPre, name, internal::kExt);
-#elif defined(CAPI_TARGET_OS_MAC)
-        CAPI_SNPRINTF(full_name, sizeof(full_name), "%s%s.%d%s", internal::kPre, name, ver, internal::kExt);
-#else
-        CAPI_SNPRINTF(full_name, sizeof(full_name), "%s%s%s.%d", internal::kPre, name, internal::kExt, ver);
-#endif
-    } else {
-        setFileName(name);
-    }
+inline void aligned_free(void* a) {
+    if (a)
+        free(reinterpret_cast<void**>(a)[-1]);
 }
-bool dso::load(bool test) {
-    handle = load(full_name, test);
-    path_from_handle(handle, full_name, sizeof(full_name));
-    return !!handle;
+// resolve in 1 pass if DLL class supports it, e.g. capi::dso. otherwise 1 by 1
+template<class DLL> auto resolve_n(DLL& lib, const char* const* syms, void** addrs, int n, int) -> decltype(lib.resolve(syms, addrs, n)) {
+    return lib.resolve(syms, addrs, n);
 }
-bool dso::unload() {
-    if (!isLoaded())
-        return true;
-    if (!unload(handle))
-        return false;
-    handle = NULL; //TODO: check ref?
-    return true;
+template<class DLL> int resolve_n(DLL& lib, const char* const* syms, void** addrs, int n, long) {
+    int resolved = 0;
+    for (int i = 0; i < n; ++i) {
+        addrs[i] = (void*)lib.resolve(syms[i]);
+        if (addrs[i])
+            ++resolved;
+    }
+    return resolved;
 }
-
-void* dso::load(const char* name, bool test) {
-    CAPI_DBG_LOAD("dso.load: %s, test: %d", name, test);
+#if !(CAPI_TARGET_OS_WIN+0)
+# define CAPI_HAS_PROBE_CACHE 1
+/*!
+ * library probe cache file is read once and kept in memory. a line is "key\tinode\tmtime\tsize\tpath\n", key is "names|versions".
+ * a new result is saved by writing a new file and renaming it, so readers always see a complete file
+ */
+class probe_cache {
+    char file[512];
+    ::std::string text; // the file content, updated by save()
+    mutable ::std::mutex lock; // save() is called by load_all() threads
+    unsigned saves;
+    probe_cache() : saves(0) {
+        const char* f = fileName();
+        if (!f[0] && getenv("CAPI_PROBE_CACHE"))
+            f = getenv("CAPI_PROBE_CACHE");
+        CAPI_SNPRINTF(file, sizeof(file), "%s", f);
+        read(text);
+    }
+    bool read(::std::string& t) const {
+        const int fd = file[0] ? ::open(file, O_RDONLY) : -1;
+        if (fd < 0)
+            return false;
+        struct stat st;
+        if (::fstat(fd, &st) == 0 && st.st_size > 0) {
+            t.resize(st.st_size);
+            const ssize_t n = ::read(fd, &t[0], t.size());
+            t.resize(n > 0 ? n : 0);
+        }
+        ::close(fd);
+        return true;
+    }
+    // return the line of key in t, or null
+    static const char* line(const ::std::string& t, const char* key, const char** eol) {
+        const size_t klen = strlen(key);
+        for (const char *p = t.data(), *end = t.data() + t.size(); p < end; p = *eol + 1) {
+            *eol = static_cast<const char*>(memchr(p, '\n', end - p));
+            if (!*eol)
+                break;
+            if (size_t(*eol - p) > klen && memcmp(p, key, klen) == 0 && p[klen] == '\t')
+                return p;
+        }
+        return NULL;
+    }
+public:
+    static char* fileName() {
+        static char f[512];
+        return f;
+    }
+    static probe_cache& instance() {
+        static probe_cache c;
+        return c;
+    }
+    static bool makeKey(const char* names[], const int versions[], char* key, int len) {
+        int n = 0;
+        for (int i = 0; names[i] && n >= 0 && n < len; ++i)
+            n += CAPI_SNPRINTF(key + n, len - n, i ? ",%s" : "%s", names[i]);
+        for (int j = 0; versions[j] != ::capi::EndVersion && n >= 0 && n < len; ++j)
+            n += CAPI_SNPRINTF(key + n, len - n, j ? ",%d" : "|%d", versions[j]);
+        return n >= 0 && n < len;
+    }
+    bool enabled() const { return !!file[0];}
+    // get the cached path if the file is not changed
+    bool find(const char* key, char* path, int len) const {
+        char buf[1024];
+        {
+            ::std::lock_guard< ::std::mutex> l(lock);
+            const char* eol = NULL;
+            const char* p = line(text, key, &eol);
+            if (!p)
+                return false;
+            CAPI_SNPRINTF(buf, sizeof(buf), "%.*s", int(eol - p), p);
+        }
+        unsigned long long ino = 0, size = 0;
+        long long mtime = 0;
+        int pos = 0;
+        if (sscanf(buf + strlen(key), "\t%llu\t%lld\t%llu\t%n", &ino, &mtime, &size, &pos) != 3 || !pos)
+            return false;
+        struct stat st;
+        if (::stat(buf + strlen(key) + pos, &st) != 0
+            || (unsigned long long)st.st_ino != ino || (long long)st.st_mtime != mtime || (unsigned long long)st.st_size != size)
+            return false;
+        CAPI_SNPRINTF(path, len, "%s", buf + strlen(key) + pos);
+        return true;
+    }
+    // add or replace the line of key. lines saved by other libraries and processes are kept
+    void save(const char* key, const char* path) {
+        struct stat st;
+        if (path[0] != '/' || ::stat(path, &st) != 0)
+            return;
+        ::std::lock_guard< ::std::mutex> l(lock);
+        ::std::string t; // the latest file, may be updated by other processes
+        read(t);
+        const char* eol = NULL;
+        const char* old = line(t, key, &eol);
+        if (old)
+            t.erase(old - t.data(), eol + 1 - old);
+        char entry[1024];
+        CAPI_SNPRINTF(entry, sizeof(entry), "%s\t%llu\t%lld\t%llu\t%s\n", key, (unsigned long long)st.st_ino, (long long)st.st_mtime, (unsigned long long)st.st_size, path);
+        t += entry;
+        text = t;
+        char tmp[sizeof(file) + 32];
+        CAPI_SNPRINTF(tmp, sizeof(tmp), "%s.%d.%u", file, (int)::getpid(), ++saves); // unique in the process
+        FILE* f = fopen(tmp, "w");
+        if (!f)
+            return;
+        fwrite(t.data(), 1, t.size(), f);
+        if (fclose(f) != 0 || rename(tmp, file) != 0)
+            remove(tmp);
+    }
+};
+# define CAPI_HAS_CACHE_DIR 1
+inline char* cache_dir_setting() {
+    static char d[512];
+    return d;
+}
+// set by setSymbolCacheDir(), or environment var CAPI_SYMBOL_CACHE
+inline const char* cache_dir() {
+    const char* d = cache_dir_setting();
+    if (!d[0] && getenv("CAPI_SYMBOL_CACHE"))
+        d = getenv("CAPI_SYMBOL_CACHE");
+    return d;
+}
+// fnv-1a of a symbol list, identifies an api_dll entry list in cache files
+inline uint64_t names_hash(const char* const* syms, int n) {
+    uint64_t h = 14695981039346656037ULL;
+    for (int i = 0; i < n; ++i) {
+        for (const unsigned char* c = reinterpret_cast<const unsigned char*>(syms[i]); ; ++c) {
+            h = (h ^ *c) * 1099511628211ULL;
+            if (!*c)
+                break;
+        }
+    }
+    return h;
+}
+#endif
+// load the cached path of names x versions. only for DLL classes like capi::dso which have setFileName(path()).
+template<class DLL> auto load_cached(DLL& lib, const char* names[], const int versions[], int) -> decltype(lib.setFileName(lib.path()), bool()) {
+#if (CAPI_HAS_PROBE_CACHE+0)
+    const probe_cache& c = probe_cache::instance();
+    char key[1024], path[512];
+    if (!c.enabled() || !probe_cache::makeKey(names, versions, key, sizeof(key)))
+        return false;
+    if (c.find(key, path, sizeof(path))) {
+        lib.setFileName(path);
+        if (lib.load(false)) {
+            CAPI_DBG_LOAD("capi loaded cached path: %s", path);
+            return true;
+        }
+    }
+    return false;
+#else
+    return false;
+#endif
+}
+template<class DLL> bool load_cached(DLL&, const char* [], const int [], long) { return false;}
+template<class DLL> auto save_cached(DLL& lib, const char* names[], const int versions[], int) -> decltype(lib.setFileName(lib.path()), void()) {
+#if (CAPI_HAS_PROBE_CACHE+0)
+    probe_cache& c = probe_cache::instance();
+    char key[1024];
+    if (c.enabled() && probe_cache::makeKey(names, versions, key, sizeof(key)))
+        c.save(key, lib.path());
+#endif
+}
+template<class DLL> void save_cached(DLL&, const char* [], const int [], long) {}
+// true if a and b are the same loaded library. only for DLL classes like capi::dso which have nativeHandle()
+template<class DLL> auto same_library(const DLL& a, const DLL& b, int) -> decltype(a.nativeHandle(), bool()) { return a.nativeHandle() == b.nativeHandle();}
+template<class DLL> bool same_library(const DLL&, const DLL&, long) { return false;}
+// a string kept until exit, e.g. a library path of dso, or a name in a trace record which must outlive the caller's string.
+// the same string is stored once, no allocation if it exists
+inline const char* intern_string(const char* str) {
+    struct node {
+        node* next;
+        char str[1];
+    };
+    static ::std::mutex lock;
+    static node* strings[64]; // never destroyed, dso objects can be destroyed later
+    node*& head = strings[symbol_hash(str) % 64];
+    ::std::lock_guard< ::std::mutex> l(lock);
+    for (const node* n = head; n; n = n->next) {
+        if (!strcmp(n->str, str))
+            return n->str;
+    }
+    const size_t len = strlen(str) + 1;
+    node* n = static_cast<node*>(malloc(sizeof(node) + len));
+    memcpy(n->str, str, len);
+    n->next = head;
+    head = n;
+    return n->str;
+}
+#if CAPI_IS(TRACE)
+// a record is stored as relaxed atomic words, so a reader can copy a ring while the owner thread is writing, and drop overwritten records
+struct trace_slot {
+    ::std::atomic<uint64_t> w[5];
+};
+struct trace_ring {
+    static_assert((CAPI_TRACE_RING_SIZE & (CAPI_TRACE_RING_SIZE - 1)) == 0, "CAPI_TRACE_RING_SIZE must be power of 2");
+    ::std::atomic<uint64_t> head; // number of records written
+    ::std::atomic<uint64_t> pending; // number of records written or being written
+    trace_ring* next;
+    ::std::atomic<bool> used;
+    int thread; // index of the owner thread, stored in each record
+    trace_slot slots[CAPI_TRACE_RING_SIZE];
+};
+inline ::std::atomic<trace_ring*>& trace_rings() {
+    static ::std::atomic<trace_ring*> r(nullptr);
+    return r;
+}
+// the ring of an exited thread keeps its records to dump, and a new thread continues writing in it, so the number of rings is the number of threads alive at the same time
+inline trace_ring* local_trace_ring() {
+    static ::std::atomic<int> threads(0);
+    static thread_local trace_ring* ring = nullptr; // trivial, no tls init check in an event
+    if (ring)
+        return ring;
+    struct owner {
+        trace_ring* ring = nullptr;
+        ~owner() {
+            if (ring)
+                ring->used.store(false, ::std::memory_order_release);
+        }
+    };
+    static thread_local owner o;
+    trace_ring* r = trace_rings().load(::std::memory_order_acquire);
+    for (; r; r = r->next) {
+        bool used = false;
+        if (r->used.compare_exchange_strong(used, true, ::std::memory_order_acquire))
+            break;
+    }
+    if (!r) {
+        r = static_cast<trace_ring*>(calloc(1, sizeof(trace_ring)));
+        r->used.store(true, ::std::memory_order_relaxed);
+        r->next = trace_rings().load(::std::memory_order_relaxed);
+        while (!trace_rings().compare_exchange_weak(r->next, r, ::std::memory_order_release, ::std::memory_order_relaxed)) {}
+    }
+    r->thread = threads++;
+    o.ring = r;
+    ring = r;
+    return r;
+}
+inline void trace_event(::capi::trace::event type, const char* name, const void* handle, intptr_t result) {
+    trace_ring* r = local_trace_ring();
+    const uint64_t i = r->head.load(::std::memory_order_relaxed);
+    ::std::atomic<uint64_t>* w = r->slots[i & (CAPI_TRACE_RING_SIZE - 1)].w;
+    r->pending.store(i + 1, ::std::memory_order_relaxed); // a reader checks pending after copying, the old record in the slot is invalid now
+    ::std::atomic_thread_fence(::std::memory_order_release);
+    w[0].store(::std::chrono::duration_cast< ::std::chrono::nanoseconds>(::std::chrono::steady_clock::now().time_since_epoch()).count(), ::std::memory_order_relaxed);
+    w[1].store((uintptr_t)name, ::std::memory_order_relaxed);
+    w[2].store((uintptr_t)handle, ::std::memory_order_relaxed);
+    w[3].store((uint64_t)result, ::std::memory_order_relaxed);
+    w[4].store((uint64_t)type | (uint64_t)(uint32_t)r->thread << 32, ::std::memory_order_relaxed);
+    r->head.store(i + 1, ::std::memory_order_release);
+}
+#endif //CAPI_IS(TRACE)
+template<class DLL> auto set_load_flags(DLL& lib, int flags, int) -> decltype(lib.setLoadFlags(flags), void()) { lib.setLoadFlags(flags);}
+template<class DLL> void set_load_flags(DLL&, int, long) {}
+// base ctor dll_helper("name")=>derived members in decl order(entries)=>derived ctor
+static const int kDefaultVersions[] = {::capi::NoVersion, ::capi::EndVersion};
+template <class DLL> class dll_helper { //no CAPI_EXPORT required
+public:
+    typedef DLL dll_type;
+private:
+    DLL m_lib;
+    typename dso_trait<DLL>::str_t strType(const char* s) {
+        return dso_trait<DLL>::qstr_t::fromLatin1(s);
+    }
+public:
+    // load the first library of names x versions, or only path if it's not null
+    dll_helper(const char* names[], const int versions[] = kDefaultVersions, bool test = false, int flags = 0, const char* path = nullptr) {
+        set_load_flags(m_lib, flags, 0);
+        static ::std::atomic<bool> is_1st(true); // dlls can be loaded in parallel by load_all()
+        if (is_1st.exchange(false, ::std::memory_order_relaxed)) {
+            fprintf(stderr, "capi::version: %s\n", ::capi::version::name);
+        }
+        if (path) {
+            m_lib.setFileName(strType(path));
+            const bool ok = m_lib.load(test);
+            if (!ok) {
+                CAPI_WARN_LOAD("capi can not load %s", path);
+            }
+            CAPI_TRACE(Load, intern_string(path), this, ok);
+            return;
+        }
+        if (!test && load_cached(m_lib, names, versions, 0)) {
+            CAPI_TRACE(Load, intern_string(names[0]), this, true);
+            return;
+        }
+        for (int i = 0; names[i]; ++i) {
+            for (int j = 0; versions[j] != ::capi::EndVersion; ++j) {
+                if (versions[j] == ::capi::NoVersion)
+                    m_lib.setFileName(strType(names[i]));
+                else
+                    m_lib.setFileNameAndVersion(strType(names[i]), versions[j]);
+                if (m_lib.load(test)) {
+                    CAPI_DBG_LOAD("capi loaded {library name: %s, version: %d}: %s, test: %d", names[i], versions[j], m_lib.path(), test);
+                    CAPI_TRACE(Load, intern_string(names[i]), this, true);
+                    if (!test)
+                        save_cached(m_lib, names, versions, 0);
+                    return;
+                }
+                CAPI_WARN_LOAD("capi can not load {library name: %s, version %d, test: %d}", names[i], versions[j], test);
+            }
+        }
+        CAPI_TRACE(Load, intern_string(names[0]), this, false);
+    }
+    virtual ~dll_helper() { m_lib.unload();}
+    bool isLoaded() const { return m_lib.isLoaded(); }
+    bool isSameLibrary(const dll_helper& other) const { return same_library(m_lib, other.m_lib, 0);}
+    void* resolve(const char *symbol) {
+        void* p = (void*)m_lib.resolve(symbol);
+        CAPI_TRACE(Resolve, intern_string(symbol), this, p); // symbol can be a temporary string
+        return p;
+    }
+    // resolve n symbols in 1 pass. return the number of resolved symbols, addrs[i] is null if syms[i] is not found
+    int resolve(const char* const* syms, void** addrs, int n) {
+        const int resolved = resolve_n(m_lib, syms, addrs, n, 0);
+        CAPI_TRACE(ResolveAll, nullptr, this, resolved);
+        return resolved;
+    }
+};
+#ifdef CAPI_TARGET_OS_WIN
+    static const char kPre[] = "";
+    static const char kExt[] = ".dll";
+#else
+    static const char kPre[] = "lib";
+#ifdef CAPI_TARGET_OS_MAC
+    static const char kExt[] = ".dylib";
+#else
+    static const char kExt[] = ".so";
+#endif
+#endif
+/*!
+ * publish a lazily resolved symbol. the first writer wins and others use the winner's value, so the fast path is a single acquire load
+ */
+template<typename F> F publish(::std::atomic<F>& slot, F f) {
+    F old = nullptr;
+    if (!slot.compare_exchange_strong(old, f, ::std::memory_order_acq_rel, ::std::memory_order_acquire))
+        return old;
+    return f;
+}
+// replace a trampoline stub by the resolved address. the stub is kept if failed to resolve
+template<typename F> F patch(::std::atomic<F>& slot, F f) {
+    if (f)
+        slot.store(f, ::std::memory_order_release);
+    return f;
+}
+/*!
+ * process wide ref counted dll object of a library(an api_dll type), shared by class style api objects and the namespace style dll object,
+ * so the library is loaded and resolved once. it's deleted(and the library is unloaded) when the last reference is released.
+ * a new object is created for every acquire() if the DLL class is an isolated_dso.
+ * an object is constructed in static storage, so no heap allocation unless multiple objects are alive, e.g. reloaded or isolated
+ */
+template<class T> class registry {
+    struct node {
+        T* object;
+        int refs;
+        node* next;
+    };
+    struct shared {
+        ::std::mutex lock;
+        node* head; // the current object, followed by reloaded ones still in use
+        node first; // node of the object in storage if first.object is not null
+        typename ::std::aligned_storage<sizeof(T), alignof(T)>::type storage;
+    };
+    static shared& instance() {
+        static shared s{{}, nullptr, {}, {}};
+        return s;
+    }
+public:
+    static T* acquire() {
+        shared& s = instance();
+        ::std::lock_guard< ::std::mutex> lock(s.lock);
+        if (!s.head || ::std::is_base_of< ::capi::isolated_dso, typename T::dll_type>::value) {
+            if (!s.first.object) {
+                s.first = node{::new (&s.storage) T(), 0, s.head}; // not T::operator new
+                s.head = &s.first;
+            } else {
+                s.head = new node{new T(), 0, s.head};
+            }
+        }
+        ++s.head->refs;
+        return s.head->object;
+    }
+    // make a reloaded object current with 1 reference
+    static void add(T* p) {
+        shared& s = instance();
+        ::std::lock_guard< ::std::mutex> lock(s.lock);
+        s.head = new node{p, 1, s.head};
+    }
+    static void release(T* p) {
+        if (!p)
+            return;
+        shared& s = instance();
+        node* d = nullptr;
+        {
+            ::std::lock_guard< ::std::mutex> lock(s.lock);
+            node** n = &s.head;
+            while (*n && (*n)->object != p)
+                n = &(*n)->next;
+            assert(*n && (*n)->refs > 0 && "not acquired from registry");
+            if (--(*n)->refs > 0)
+                return;
+            d = *n;
+            *n = d->next;
+            if (d != &s.first) {
+                delete d;
+                d = nullptr;
+            }
+        }
+        if (!d) {
+            delete p;
+            return;
+        }
+        p->~T(); // unload out of the lock, then storage can be reused
+        ::std::lock_guard< ::std::mutex> lock(s.lock);
+        s.first.object = nullptr;
+    }
+};
+/*!
+ * get or create the namespace style global dll object. only 1 thread wins the CAS and constructs(dlopen) it,
+ * others block on a condition variable until it's published. the mutex is used only while loading
+ */
+template<class T> T* busy() { return reinterpret_cast<T*>(intptr_t(1));}
+template<class T> struct instance_latch {
+    static ::std::mutex& mutex() {
+        static ::std::mutex m;
+        return m;
+    }
+    static ::std::condition_variable& cond() {
+        static ::std::condition_variable c;
+        return c;
+    }
+};
+template<class T> CAPI_NOINLINE T* create_instance(::std::atomic<T*>& p) {
+    T* const busy = internal::busy<T>();
+    T* d = nullptr;
+    if (p.compare_exchange_strong(d, busy, ::std::memory_order_acquire)) {
+        d = registry<T>::acquire(); // never released
+        {
+            ::std::lock_guard< ::std::mutex> lock(instance_latch<T>::mutex());
+            p.store(d, ::std::memory_order_release);
+        }
+        instance_latch<T>::cond().notify_all();
+        return d;
+    }
+    ::std::unique_lock< ::std::mutex> lock(instance_latch<T>::mutex()); // loading a heavy library can take a while
+    instance_latch<T>::cond().wait(lock, [&] { return (d = p.load(::std::memory_order_acquire)) != busy;});
+    return d;
+}
+template<class T> T* instance(::std::atomic<T*>& p) {
+    T* const d = p.load(::std::memory_order_acquire);
+    if (d && d != busy<T>())
+        return d;
+    return create_instance(p);
+}
+#if CAPI_IS(RELOAD)
+// the dll object used by a thread's namespace style call. slots of exited threads are kept and reused by new threads
+struct hazard_slot {
+    ::std::atomic<void*> object;
+    ::std::atomic<bool> used;
+    int depth; // nested calls, e.g. from a callback, use the outer call's object
+    hazard_slot* next;
+};
+template<class T> struct hazards {
+    static ::std::atomic<hazard_slot*>& head() {
+        static ::std::atomic<hazard_slot*> h(nullptr);
+        return h;
+    }
+    static hazard_slot* local() {
+        struct owner {
+            hazard_slot* slot = nullptr;
+            ~owner() {
+                if (slot)
+                    slot->used.store(false, ::std::memory_order_release);
+            }
+        };
+        static thread_local owner o;
+        if (!o.slot)
+            o.slot = add();
+        return o.slot;
+    }
+    // wait until no call is using p
+    static void drain(const T* p) {
+        for (hazard_slot* h = head().load(::std::memory_order_acquire); h; h = h->next) {
+            for (int spin = 0; h->object.load(::std::memory_order_seq_cst) == p; ++spin) {
+                if (spin < 64)
+                    ::std::this_thread::yield();
+                else
+                    ::std::this_thread::sleep_for(::std::chrono::microseconds(100));
+            }
+        }
+    }
+private:
+    static hazard_slot* add() {
+        for (hazard_slot* h = head().load(::std::memory_order_acquire); h; h = h->next) {
+            bool used = false;
+            if (h->used.compare_exchange_strong(used, true, ::std::memory_order_acquire))
+                return h;
+        }
+        hazard_slot* h = new hazard_slot();
+        h->object.store(nullptr, ::std::memory_order_relaxed);
+        h->used.store(true, ::std::memory_order_relaxed);
+        h->depth = 0;
+        h->next = head().load(::std::memory_order_relaxed);
+        while (!head().compare_exchange_weak(h->next, h, ::std::memory_order_release, ::std::memory_order_relaxed)) {}
+        return h;
+    }
+};
+/*!
+ * protect the namespace style dll object during a call. publish it in the thread's hazard slot and check it's still current,
+ * then reload() will not delete it until the slot is cleared. no lock or rmw is used
+ */
+template<class T> class hazard_guard {
+    hazard_slot* h;
+public:
+    hazard_guard(::std::atomic<T*>& p) : h(hazards<T>::local()) {
+        if (h->depth++ > 0)
+            return;
+        T* d = instance(p);
+        for (;;) {
+            h->object.store(d, ::std::memory_order_seq_cst);
+            T* cur = p.load(::std::memory_order_seq_cst);
+            if (cur == d)
+                break;
+            d = cur;
+        }
+    }
+    ~hazard_guard() {
+        if (--h->depth == 0)
+            h->object.store(nullptr, ::std::memory_order_release);
+    }
+    T* get() const { return static_cast<T*>(h->object.load(::std::memory_order_relaxed));}
+};
+template<class T> bool reload(::std::atomic<T*>& p, const char* path) {
+    static ::std::mutex lock;
+    ::std::lock_guard< ::std::mutex> l(lock);
+    const T* cur = instance(p);
+    T* d = new T(false, path);
+    if (!d->isLoaded() || d->isSameLibrary(*cur)) {
+        delete d;
+        return false;
+    }
+    d->resolveAll();
+    registry<T>::add(d);
+    T* old = p.exchange(d, ::std::memory_order_seq_cst);
+    hazards<T>::drain(old);
+    registry<T>::release(old);
+    return true;
+}
+#else
+// the namespace style dll object is never replaced without reload
+template<class T> class hazard_guard {
+    T* d;
+public:
+    hazard_guard(::std::atomic<T*>& p) : d(instance(p)) {}
+    T* get() const { return d;}
+};
+#endif //CAPI_IS(RELOAD)
+template<class T> class ns_dll_loader : public dll_loader {
+    ::std::atomic<T*>& p;
+public:
+    explicit ns_dll_loader(::std::atomic<T*>& p) : dll_loader(T::libraryName()), p(p) {}
+    bool load(bool resolve) override {
+        hazard_guard<T> guard(p); // not deleted by reload() while resolving
+        T* d = guard.get();
+        if (resolve && d->isLoaded())
+            d->resolveAll();
+        return d->isLoaded();
+    }
+};
+/*!
+ * load the namespace style dll object in a new thread, and resolve all symbols if resolve is true. the result is dll.isLoaded().
+ * loaded() and wrappers called before loading is finished will wait
+ */
+template<class T> ::std::shared_future<bool> preload(::std::atomic<T*>& p, bool resolve) {
+    ::std::promise<bool>* loaded = new ::std::promise<bool>(); // not packaged_task, it's slow to compile in each library
+    ::std::shared_future<bool> f = loaded->get_future().share();
+    ::std::thread([&p, resolve, loaded] { // future from a promise does not block in dtor, unlike std::async
+        hazard_guard<T> guard(p);
+        T* d = guard.get();
+        if (resolve && d->isLoaded())
+            d->resolveAll();
+        loaded->set_value(d->isLoaded());
+        delete loaded;
+    }).detach();
+    return f;
+}
+// lazy entries of api_t as an array. the initial value is null or a trampoline stub
+template<class Table> ::std::atomic<void*>* lazy_entries(Table& api) { return reinterpret_cast< ::std::atomic<void*>*>(&api);}
+// resolve and publish entry index of a lazy wrapper, return the published address
+template<class DLL> CAPI_NOINLINE void* resolve_entry(DLL* dll, int index) {
+    void* f = publish(lazy_entries(dll->api)[index], dll->resolve(DLL::symbols()[index]));
+    CAPI_DBG_RESOLVE("dll::api_t::%s: @%p", DLL::symbols()[index], f);
+    return f;
+}
+template<class Table> const ::std::atomic<void*>* initial_entries() {
+    static const Table init{};
+    return reinterpret_cast<const ::std::atomic<void*>*>(&init);
+}
+// publish addrs[i] to entry idx[i] if the entry is still the initial value
+template<class Table> void publish_all(Table& api, const int* idx, void* const* addrs, int n) {
+    ::std::atomic<void*>* entries = lazy_entries(api);
+    const ::std::atomic<void*>* init = initial_entries<Table>();
+    for (int i = 0; i < n; ++i) {
+        const int k = idx ? idx[i] : i;
+        void* expected = init[k].load(::std::memory_order_relaxed);
+        if (addrs[i])
+            entries[k].compare_exchange_strong(expected, addrs[i], ::std::memory_order_acq_rel, ::std::memory_order_relaxed);
+    }
+}
+// resolve all hot entries in 1 pass, wherever they are declared
+template<class DLL, class Table> int resolve_hot(DLL& dll, Table& api, const char* const* syms, const char* hot, int n) {
+    int k = 0;
+    for (int i = 0; i < n; ++i)
+        k += !!hot[i];
+    if (k == 0)
+        return 0;
+    int* idx = new int[k];
+    const char** hot_syms = new const char*[k];
+    void** addrs = new void*[k];
+    for (int i = 0, j = 0; i < n; ++i) {
+        if (!hot[i])
+            continue;
+        idx[j] = i;
+        hot_syms[j++] = syms[i];
+    }
+    const int resolved = dll.resolve(hot_syms, addrs, k);
+    publish_all(api, idx, addrs, k);
+    CAPI_DBG_RESOLVE("capi resolved %d/%d hot symbols", resolved, k);
+    delete [] addrs;
+    delete [] hot_syms;
+    delete [] idx;
+    return resolved;
+}
+// resolve all lazy entries in 1 pass
+// bit i of bits is set if addrs[i] is not null
+inline void set_available(::std::atomic<uint64_t>* bits, void* const* addrs, int n) {
+    for (int w = 0; w*64 < n; ++w) {
+        uint64_t v = 0;
+        for (int i = w*64; i < n && i < w*64 + 64; ++i)
+            v |= uint64_t(!!addrs[i]) << (i - w*64);
+        bits[w].store(v, ::std::memory_order_relaxed);
+    }
+}
+template<class DLL, class Table> int resolve_all(DLL& dll, Table& api, const char* const* syms, int n, ::std::atomic<uint64_t>* available) {
+    void** addrs = new void*[n];
+    const int resolved = dll.resolve(syms, addrs, n);
+    publish_all(api, NULL, addrs, n);
+    set_available(available, addrs, n);
+    delete [] addrs;
+    return resolved;
+}
+// fill the bitmap only, entries are not published
+template<class DLL> int find_all(DLL& dll, const char* const* syms, int n, ::std::atomic<uint64_t>* available) {
+    void** addrs = new void*[n];
+    const int found = dll.resolve(syms, addrs, n);
+    set_available(available, addrs, n);
+    delete [] addrs;
+    return found;
+}
+template<class Table> int count_resolved(const Table& api, int n, ::std::atomic<uint64_t>* available) {
+    void* const* addrs = reinterpret_cast<void* const*>(&api);
+    int resolved = 0;
+    for (int i = 0; i < n; ++i)
+        resolved += !!addrs[i];
+    set_available(available, addrs, n);
+    return resolved;
+}
+#if CAPI_IS(PROFILE_RESOLVE) && (CAPI_HAS_CACHE_DIR+0)
+# define CAPI_HAS_RESOLVE_PROFILE 1
+/*!
+ * profile file "dir/<hash of symbol list>.used" is a header followed by a bitmap of entries resolved in previous runs
+ */
+class resolve_profile {
+    struct header {
+        char magic[4];
+        uint32_t count;
+        uint64_t names_hash;
+    };
+    char file[512+32];
+    header h;
+public:
+    resolve_profile(const char* const* syms, int n) {
+        memset(&h, 0, sizeof(h));
+        memcpy(h.magic, "capu", 4);
+        h.count = n;
+        h.names_hash = names_hash(syms, n);
+        const char* dir = cache_dir();
+        if (!dir[0] || CAPI_SNPRINTF(file, sizeof(file), "%s/%016llx.used", dir, (unsigned long long)h.names_hash) >= (int)sizeof(file))
+            file[0] = 0;
+    }
+    bool enabled() const { return !!file[0];}
+    size_t size() const { return (h.count + 7)/8;}
+    // add entries in profile to bits. return false if no valid profile
+    bool load(unsigned char* bits) const {
+        FILE* f = enabled() ? fopen(file, "rb") : NULL;
+        if (!f)
+            return false;
+        header fh;
+        unsigned char* b = new unsigned char[size()];
+        const bool ok = fread(&fh, sizeof(fh), 1, f) == 1 && memcmp(&fh, &h, sizeof(h)) == 0 && fread(b, 1, size(), f) == size();
+        fclose(f);
+        for (size_t i = 0; ok && i < size(); ++i)
+            bits[i] |= b[i];
+        delete [] b;
+        return ok;
+    }
+    void save(const unsigned char* bits) const {
+        if (!enabled())
+            return;
+        ::mkdir(cache_dir(), 0755);
+        char tmp[sizeof(file) + 16];
+        CAPI_SNPRINTF(tmp, sizeof(tmp), "%s.%d", file, (int)::getpid());
+        FILE* f = fopen(tmp, "wb");
+        if (!f)
+            return;
+        fwrite(&h, sizeof(h), 1, f);
+        fwrite(bits, 1, size(), f);
+        if (fclose(f) != 0 || rename(tmp, file) != 0)
+            remove(tmp);
+    }
+};
+#endif
+// resolve entries used in previous runs in 1 pass
+template<class DLL, class Table> int warm_up(DLL& dll, Table& api, const char* const* syms, int n) {
+    int resolved = 0;
+#if (CAPI_HAS_RESOLVE_PROFILE+0)
+    const resolve_profile prof(syms, n);
+    unsigned char* bits = new unsigned char[prof.size()]();
+    if (prof.load(bits)) {
+        const char** used = new const char*[n];
+        int* idx = new int[n];
+        void** addrs = new void*[n];
+        int k = 0;
+        for (int i = 0; i < n; ++i) {
+            if (bits[i/8] & (1 << (i%8))) {
+                used[k] = syms[i];
+                idx[k++] = i;
+            }
+        }
+        resolved = dll.resolve(used, addrs, k);
+        publish_all(api, idx, addrs, k);
+        CAPI_DBG_RESOLVE("capi warm up %d/%d used symbols", resolved, k);
+        delete [] used;
+        delete [] idx;
+        delete [] addrs;
+    }
+    delete [] bits;
+#else
+    (void)dll; (void)api; (void)syms; (void)n;
+#endif
+    return resolved;
+}
+// save resolved entries to profile, merged with previous runs
+template<class Table> void save_profile(Table& api, const char* const* syms, int n) {
+#if (CAPI_HAS_RESOLVE_PROFILE+0)
+    const resolve_profile prof(syms, n);
+    if (!prof.enabled())
+        return;
+    unsigned char* bits = new unsigned char[prof.size()]();
+    unsigned char* old = new unsigned char[prof.size()]();
+    const ::std::atomic<void*>* entries = lazy_entries(api);
+    const ::std::atomic<void*>* init = initial_entries<Table>();
+    for (int i = 0; i < n; ++i) {
+        if (entries[i].load(::std::memory_order_relaxed) != init[i].load(::std::memory_order_relaxed))
+            bits[i/8] |= 1 << (i%8);
+    }
+    prof.load(old);
+    bool changed = false;
+    for (size_t i = 0; i < prof.size(); ++i) {
+        changed |= (bits[i] | old[i]) != old[i];
+        bits[i] |= old[i];
+    }
+    if (changed)
+        prof.save(bits);
+    delete [] bits;
+    delete [] old;
+#else
+    (void)api; (void)syms; (void)n;
+#endif
+}
+#if CAPI_IS(STATS)
+# if CAPI_IS(STATS_RDTSC) && (defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86))
+#  ifdef _MSC_VER
+#   include <intrin.h>
+#  else
+#   include <x86intrin.h>
+#  endif
+inline uint64_t stats_ticks() { return __rdtsc();}
+# else
+inline uint64_t stats_ticks() { return ::std::chrono::duration_cast< ::std::chrono::nanoseconds>(::std::chrono::steady_clock::now().time_since_epoch()).count();}
+# endif
+// counters of an entry in a thread. only the owner thread writes, so no atomic rmw is required
+struct stats_slot {
+    ::std::atomic<uint64_t> calls;
+    ::std::atomic<uint64_t> ticks;
+    ::std::atomic<uint64_t> hist[::capi::stats::Buckets];
+};
+inline void stats_add(::std::atomic<uint64_t>& c, uint64_t v) { c.store(c.load(::std::memory_order_relaxed) + v, ::std::memory_order_relaxed);}
+/*!
+ * counters of all entries of a library in a thread, followed by the slots. a block is 64 byte aligned and padded, so threads do not share cache lines.
+ * the block of an exited thread keeps the counts, and a new thread continues counting in it, so the number of blocks is the number of threads alive at the same time
+ */
+struct alignas(64) stats_block {
+    stats_block* next;
+    ::std::atomic<bool> used;
+    stats_slot* slots() { return reinterpret_cast<stats_slot*>(this + 1);}
+    const stats_slot* slots() const { return reinterpret_cast<const stats_slot*>(this + 1);}
+};
+// counters of a library
+struct stats_source {
+    const char* const* names;
+    int count;
+    ::std::atomic<stats_block*> blocks;
+    stats_source* next;
+    stats_block* add_thread() {
+        for (stats_block* b = blocks.load(::std::memory_order_acquire); b; b = b->next) {
+            bool used = false;
+            if (b->used.compare_exchange_strong(used, true, ::std::memory_order_acquire))
+                return b;
+        }
+        const size_t size = (sizeof(stats_block) + count*sizeof(stats_slot) + 63) & ~size_t(63);
+        stats_block* b = static_cast<stats_block*>(aligned_alloc(size));
+        memset(static_cast<void*>(b), 0, size);
+        b->used.store(true, ::std::memory_order_relaxed);
+        b->next = blocks.load(::std::memory_order_relaxed);
+        while (!blocks.compare_exchange_weak(b->next, b, ::std::memory_order_release, ::std::memory_order_relaxed)) {}
+        return b;
+    }
+};
+inline ::std::atomic<stats_source*>& stats_sources() {
+    static ::std::atomic<stats_source*> s(nullptr);
+    return s;
+}
+template<class DLL> struct call_stats {
+    static stats_source* source() {
+        static stats_source* s = add_source();
+        return s;
+    }
+    static stats_slot* local() {
+        static thread_local stats_slot* slots = nullptr; // trivial, no tls init check in a call
+        if (slots)
+            return slots;
+        struct owner {
+            stats_block* block = nullptr;
+            ~owner() {
+                if (block)
+                    block->used.store(false, ::std::memory_order_release);
+            }
+        };
+        static thread_local owner o;
+        o.block = source()->add_thread();
+        slots = o.block->slots();
+        return slots;
+    }
+private:
+    static stats_source* add_source() {
+        stats_source* s = new stats_source();
+        s->names = DLL::symbols();
+        s->count = DLL::entry_count;
+        s->blocks.store(nullptr, ::std::memory_order_relaxed);
+        s->next = stats_sources().load(::std::memory_order_relaxed);
+        while (!stats_sources().compare_exchange_weak(s->next, s, ::std::memory_order_release, ::std::memory_order_relaxed)) {}
+        return s;
+    }
+};
+// counts a call of an entry in a wrapper, and measures the latency until the wrapper returns
+class call_scope {
+    stats_slot& slot;
+# if CAPI_IS(STATS_LATENCY)
+    uint64_t t0;
+# endif
+public:
+    call_scope(stats_slot& s) : slot(s) {
+        stats_add(slot.calls, 1);
+# if CAPI_IS(STATS_LATENCY)
+        t0 = stats_ticks();
+# endif
+    }
+# if CAPI_IS(STATS_LATENCY)
+    ~call_scope() {
+        const uint64_t dt = stats_ticks() - t0;
+        int b = 0;
+        for (uint64_t t = dt; t && b < ::capi::stats::Buckets - 1; t >>= 1)
+            ++b;
+        stats_add(slot.ticks, dt);
+        stats_add(slot.hist[b], 1);
+    }
+# endif
+};
+#endif //CAPI_IS(STATS)
+// save the profile of namespace style dll object at exit
+template<class T> struct profile_saver {
+    ::std::atomic<T*>& dll;
+    profile_saver(::std::atomic<T*>& d) : dll(d) {}
+    ~profile_saver() {
+        T* d = dll.load(::std::memory_order_acquire);
+        if (d && d != busy<T>())
+            d->saveProfile();
+    }
+};
+} //namespace internal
+namespace internal {
+// the namespace style dll object of a library used by ::capi::function
+struct function_table {
+    void* (*entry)(int index); // resolved address of an entry, or null if not found or not loaded
+#if CAPI_IS(STATS)
+    stats_slot* (*stats)(); // counters of the calling thread
+#endif
+};
+// resolve the entry like a wrapper does, so hot entries, preload(true), the resolve profile, available entries etc. share the result
+template<class DLL> void* function_entry(int index) {
+    DLL* d = DLL::instance();
+    if (!d->isLoaded())
+        return nullptr;
+#if CAPI_IS(LAZY_RESOLVE)
+    ::std::atomic<void*>& e = lazy_entries(d->api)[index];
+    void* f = e.load(::std::memory_order_acquire);
+    if (f != initial_entries<typename DLL::api_t>()[index].load(::std::memory_order_relaxed))
+        return f;
+# if CAPI_IS(TRAMPOLINE)
+    return patch(e, d->resolve(DLL::symbols()[index]));
+# else
+    return resolve_entry(d, index);
+# endif
+#else
+    return reinterpret_cast<void* const*>(&d->api)[index];
+#endif
+}
+template<class DLL> struct function_ops {
+    static const function_table table;
+};
+template<class DLL> const function_table function_ops<DLL>::table = {
+    &function_entry<DLL>,
+#if CAPI_IS(STATS)
+    &call_stats<DLL>::local,
+#endif
+};
+} //namespace internal
+/*!
+ * a function object of an api, alternative to the functions defined by CAPI_DEFINE and CAPI_ARGn, for namespace style only.
+ * arguments are perfectly forwarded to the function pointer, and any number of parameters is supported.
+ * it calls the entry of the same name in api_t of the namespace style dll object, resolved at the first call if it's not resolved yet,
+ * then a call is an acquire load of the entry's copy and an indirect call. if the symbol is not found, a call returns R() instead.
+ * declare it in header, e.g. zlib_api.h:
+ *   #include "capi.h"
+ *   namespace zlib { namespace capi {
+ *   extern ::capi::function<const char*(int)> zError;
+ *   } }
+ * and define it in zlib_api.cpp after CAPI_DEFINE_DLL, or CAPI_DEFINE_NS_DLL if class api is not used:
+ *   CAPI_DEFINE_FUNCTION(zError)
+ */
+template<typename F> class function;
+template<typename R, typename... Args> class function<R(Args...)> {
+public:
+    typedef R (*pointer)(Args...);
+    // index: CAPI_ENTRY_INDEX(name) of the entry
+    constexpr function(const char* name, int index, const internal::function_table* table) : fn(nullptr), name(name), index(index), table(table) {}
+    template<typename... T> R operator()(T&&... a) const {
+#if CAPI_IS(STATS)
+        const internal::call_scope capi_call_scope(table->stats()[index]);
+#endif
+        CAPI_TRACE(Call, name, nullptr, 0);
+        pointer f = fn.load(::std::memory_order_acquire);
+        if (!f && !(f = resolve())) {
+            CAPI_WARN_CALL("capi::function %s is not resolved", name);
+            return R();
+        }
+        return f(::std::forward<T>(a)...);
+    }
+    // the entry is never changed once resolved, no reload
+    pointer resolve() const {
+        const pointer f = (pointer)table->entry(index);
+        CAPI_DBG_RESOLVE("capi::function %s: @%p", name, (void*)f);
+        if (f)
+            fn.store(f, ::std::memory_order_release);
+        return f;
+    }
+private:
+    mutable ::std::atomic<pointer> fn; // a copy of the resolved entry
+    const char* name;
+    int index;
+    const internal::function_table* table;
+};
+#if CAPI_IS(STATS)
+namespace stats {
+snapshot take() {
+    snapshot s;
+    for (const internal::stats_source* src = internal::stats_sources().load(::std::memory_order_acquire); src; src = src->next) {
+        const size_t base = s.size();
+        s.resize(base + src->count, entry());
+        for (int i = 0; i < src->count; ++i)
+            s[base + i].name = src->names[i];
+        for (const internal::stats_block* b = src->blocks.load(::std::memory_order_acquire); b; b = b->next) {
+            for (int i = 0; i < src->count; ++i) {
+                entry& e = s[base + i];
+                const internal::stats_slot& slot = b->slots()[i];
+                e.calls += slot.calls.load(::std::memory_order_relaxed);
+                e.ticks += slot.ticks.load(::std::memory_order_relaxed);
+                for (int k = 0; k < Buckets; ++k)
+                    e.hist[k] += slot.hist[k].load(::std::memory_order_relaxed);
+            }
+        }
+    }
+    return s;
+}
+void merge(snapshot& to, const snapshot& from) {
+    for (size_t i = 0; i < from.size(); ++i) {
+        size_t j = 0;
+        while (j < to.size() && strcmp(to[j].name, from[i].name) != 0)
+            ++j;
+        if (j == to.size()) {
+            to.push_back(from[i]);
+            continue;
+        }
+        to[j].calls += from[i].calls;
+        to[j].ticks += from[i].ticks;
+        for (int k = 0; k < Buckets; ++k)
+            to[j].hist[k] += from[i].hist[k];
+    }
+}
+void print(const snapshot& s, FILE* f) {
+    for (size_t i = 0; i < s.size(); ++i) {
+        const entry& e = s[i];
+        if (!e.calls)
+            continue;
+        fprintf(f, "%s: %llu calls, %llu ticks, %llu ticks/call", e.name, (unsigned long long)e.calls, (unsigned long long)e.ticks, (unsigned long long)(e.ticks/e.calls));
+        for (int k = 0; k < Buckets; ++k) {
+            if (e.hist[k])
+                fprintf(f, ", <2^%d: %llu", k, (unsigned long long)e.hist[k]);
+        }
+        fprintf(f, "\n");
+    }
+}
+} //namespace stats
+#endif //CAPI_IS(STATS)
+#if CAPI_IS(TRACE)
+namespace trace {
+records take() {
+    records rs;
+    for (const internal::trace_ring* r = internal::trace_rings().load(::std::memory_order_acquire); r; r = r->next) {
+        const uint64_t end = r->head.load(::std::memory_order_acquire);
+        const uint64_t begin = end > CAPI_TRACE_RING_SIZE ? end - CAPI_TRACE_RING_SIZE : 0;
+        const size_t base = rs.size();
+        for (uint64_t i = begin; i < end; ++i) {
+            const ::std::atomic<uint64_t>* w = r->slots[i & (CAPI_TRACE_RING_SIZE - 1)].w;
+            record rec;
+            rec.time = w[0].load(::std::memory_order_relaxed);
+            rec.name = (const char*)(uintptr_t)w[1].load(::std::memory_order_relaxed);
+            rec.handle = (const void*)(uintptr_t)w[2].load(::std::memory_order_relaxed);
+            rec.result = (intptr_t)w[3].load(::std::memory_order_relaxed);
+            const uint64_t w4 = w[4].load(::std::memory_order_relaxed);
+            rec.type = (int)(w4 & 0xffffffff);
+            rec.thread = (int)(w4 >> 32);
+            rs.push_back(rec);
+        }
+        ::std::atomic_thread_fence(::std::memory_order_acquire);
+        const uint64_t pending = r->pending.load(::std::memory_order_relaxed); // records before pending - CAPI_TRACE_RING_SIZE were overwritten while copying
+        const uint64_t valid = pending > CAPI_TRACE_RING_SIZE ? pending - CAPI_TRACE_RING_SIZE : 0;
+        if (valid > begin)
+            rs.erase(rs.begin() + base, rs.begin() + base + (size_t)::std::min(valid - begin, end - begin));
+    }
+    ::std::stable_sort(rs.begin(), rs.end(), [](const record& a, const record& b) { return a.time < b.time;});
+    return rs;
+}
+void print(const records& r, FILE* f) {
+    static const char* const types[] = { "load", "resolve", "resolve all", "call" };
+    const uint64_t t0 = r.empty() ? 0 : r[0].time;
+    for (size_t i = 0; i < r.size(); ++i) {
+        const record& e = r[i];
+        fprintf(f, "+%llu ns [%d] %s %s %p: ", (unsigned long long)(e.time - t0), e.thread, types[e.type], e.name ? e.name : "-", e.handle);
+        if (e.type == Resolve)
+            fprintf(f, "%p\n", (void*)e.result);
+        else
+            fprintf(f, "%lld\n", (long long)e.result);
+    }
+}
+} //namespace trace
+#endif //CAPI_IS(TRACE)
+namespace internal {
+// prefix(if not 0) + n chars of sym, null terminated. sym itself if it's the same string, otherwise a copy on stack unless it's long
+class symbol_name {
+    char buf[128];
+    char* heap;
+    const char* s;
+    symbol_name(const symbol_name&);
+    symbol_name& operator=(const symbol_name&);
+public:
+    symbol_name(char prefix, const char* sym, size_t n) : heap(NULL), s(sym) {
+        if (!prefix && !sym[n])
+            return;
+        const size_t len = n + !!prefix;
+        char* p = buf;
+        if (len >= sizeof(buf))
+            p = heap = new char[len + 1];
+        s = p;
+        if (prefix)
+            *p++ = prefix;
+        memcpy(p, sym, n);
+        p[n] = 0;
+    }
+    ~symbol_name() { delete [] heap;}
+    const char* c_str() const { return s;}
+};
+} //namespace internal
+void dso::setFileName(const char* name) {
+    CAPI_DBG_LOAD("dso.setFileName(\"%s\")", name);
+    if (name[0] == '/') {
+        full_name = internal::intern_string(name);
+        return;
+    }
+    char path[512];
+    CAPI_SNPRINTF(path, sizeof(path), "%s%s%s", internal::kPre, name, internal::kExt);
+    full_name = internal::intern_string(path);
+}
+void dso::setFileNameAndVersion(const char* name, int ver) {
+    CAPI_DBG_LOAD("dso.setFileNameAndVersion(\"%s\", %d)", name, ver);
+    if (ver < 0) {
+        setFileName(name);
+        return;
+    }
+    char path[512];
+#if defined(CAPI_TARGET_OS_WIN) // ignore version on win. xxx-V.dll?
+    CAPI_SNPRINTF(path, sizeof(path), "%s%s%s", internal::kPre, name, internal::kExt);
+#elif defined(CAPI_TARGET_OS_MAC)
+    CAPI_SNPRINTF(path, sizeof(path), "%s%s.%d%s", internal::kPre, name, ver, internal::kExt);
+#else
+    CAPI_SNPRINTF(path, sizeof(path), "%s%s%s.%d", internal::kPre, name, internal::kExt, ver);
+#endif
+    full_name = internal::intern_string(path);
+}
+namespace internal {
+inline void page_in(void* handle);
+} //namespace internal
+#if (__ELF__+0) || (__MACH__+0) || defined(CAPI_TARGET_OS_WIN)
+# define CAPI_SYMBOL_PREFIX 0 // no prefix in ELF and PE names. mach-o names have '_' but dlsym() adds it
+#else
+# define CAPI_SYMBOL_PREFIX -1 // old a.out systems add an underscore in front of symbols. detected by the first resolved symbol
+#endif
+bool dso::load(bool test) {
+    handle = load(full_name, test);
+    sym_prefix.store(CAPI_SYMBOL_PREFIX, ::std::memory_order_relaxed);
+    internal::resolve_cache* c = cache.load(::std::memory_order_relaxed);
+    if (c || (handle && (load_flags & ResolveCache))) // a new cache because it may be another library. the old one may be in use by resolve() in other threads
+        cache.store(new internal::resolve_cache(c), ::std::memory_order_release);
+    if (handle) {
+        char path[512];
+        CAPI_SNPRINTF(path, sizeof(path), "%s", full_name);
+        full_name = internal::intern_string(path_from_handle(handle, path, sizeof(path)));
+    }
+    return !!handle;
+}
+bool dso::unload() {
+    if (!isLoaded())
+        return true;
+    if (!unload(handle))
+        return false;
+    handle = NULL; //TODO: check ref?
+    return true;
+}
+
+void* dso::load(const char* name, bool test) {
+    CAPI_DBG_LOAD("dso.load: %s, test: %d", name, test);
 #ifdef CAPI_TARGET_OS_WIN
 #ifdef CAPI_TARGET_OS_WINRT
     wchar_t wname[128+1]; // enough. strlen is not const expr
@@ -403,11 +2351,31 @@ void* dso::load(const char* name, bool test) {
     return (void*)::LoadLibraryExA(name, NULL, 0); //DONT_RESOLVE_DLL_REFERENCES
 #endif
 #else
-    int flags = RTLD_LAZY|RTLD_LOCAL;
+    int flags = (load_flags & LoadNow) ? RTLD_NOW : RTLD_LAZY;
+    flags |= (load_flags & LoadGlobal) ? RTLD_GLOBAL : RTLD_LOCAL;
+# ifdef RTLD_DEEPBIND
+    if (load_flags & LoadDeepBind)
+        flags |= RTLD_DEEPBIND;
+# endif
     if (test)
         flags |= RTLD_NOLOAD; // gnu/apple extension
-    return ::dlopen(name, flags); // try no prefix name if error? TODO: ios |RTLD_GLOBAL?
+    void* h = ::dlopen(name, flags); // try no prefix name if error?
+    if (h && !test && (load_flags & LoadNeeded))
+        internal::page_in(h);
+    return h;
+#endif
+}
+void* isolated_dso::load(const char* name, bool test) {
+#if defined(LM_ID_NEWLM) && !(CAPI_TARGET_OS_MAC+0)
+    if (!test) {
+        CAPI_DBG_LOAD("isolated_dso.load: %s", name);
+        void* h = ::dlmopen(LM_ID_NEWLM, name, ((load_flags & LoadNow) ? RTLD_NOW : RTLD_LAZY)|RTLD_LOCAL); // RTLD_GLOBAL is invalid for a new namespace
+        if (h && (load_flags & LoadNeeded))
+            internal::page_in(h);
+        return h;
+    }
 #endif
+    return dso::load(name, test);
 }
 bool dso::unload(void* h) {
 #ifdef CAPI_TARGET_OS_WIN
@@ -419,24 +2387,410 @@ bool dso::unload(void* h) {
 #endif
     return true;
 }
-void* dso::resolve(const char* sym, bool try_) {
-    const char* s = sym;
-    char _s[512]; // old a.out systems add an underscore in front of symbols
-    if (!try_) {//previous has no '_', now has '_'
-        CAPI_SNPRINTF(_s, sizeof(_s), "_%s", sym);
-        s = _s;
-    }
-    CAPI_DBG_RESOLVE("dso.resolve(\"%s\", %d)", s, try_);
+#if ((__GLIBC__+0) && defined(_GNU_SOURCE)) || defined(__FreeBSD__)
+# define CAPI_HAS_DLVSYM 1
+#endif
+void* dso::lookup(const char* sym) {
+    const char* ver = strchr(sym, '@'); // "name@VERSION"
+    if (!ver) // the literal of the entry, no copy
+        return lookup(sym, NULL);
+    const internal::symbol_name name(0, sym, size_t(ver - sym));
+    return lookup(name.c_str(), ver + 1);
+}
+void* dso::lookup(const char* name, const char* ver) {
 #ifdef CAPI_TARGET_OS_WIN
-    void *ptr = (void*)::GetProcAddress((HMODULE)handle, s);
+    (void)ver;
+    return (void*)::GetProcAddress((HMODULE)handle, name);
 #else
-    void *ptr = ::dlsym(handle, s);
+    void *ptr = NULL;
+# if (CAPI_HAS_DLVSYM+0)
+    if (ver)
+        ptr = ::dlvsym(handle, name, ver);
+# else
+    (void)ver;
+# endif
+    if (!ptr)
+        ptr = ::dlsym(handle, name); // the default version
+    return ptr;
 #endif
-    if (!ptr && try_)
-        return resolve(sym, false);
+}
+void* dso::resolve(const char* sym) {
+    internal::resolve_cache* c = cache.load(::std::memory_order_acquire);
+    if (!c)
+        return find(sym);
+    const uint64_t h = internal::resolve_cache::hash(sym);
+    void* ptr = NULL;
+    if (c->get(sym, h, &ptr))
+        return ptr;
+    return resolve_miss(c, sym, h);
+}
+void* dso::resolve_miss(internal::resolve_cache* c, const char* sym, uint64_t h) {
+    void* ptr = find(sym);
+    c->put(sym, h, ptr);
+    return ptr;
+}
+void* dso::find(const char* sym) {
+    const int prefix = sym_prefix.load(::std::memory_order_relaxed);
+    CAPI_DBG_RESOLVE("dso.resolve(\"%s\"), prefix: %d", sym, prefix);
+    void* ptr = NULL;
+    if (prefix <= 0) {
+        ptr = lookup(sym);
+        if (ptr && prefix < 0)
+            sym_prefix.store(0, ::std::memory_order_relaxed);
+        if (ptr || prefix == 0)
+            return ptr;
+    }
+    const char* ver = strchr(sym, '@');
+    ptr = lookup(internal::symbol_name('_', sym, ver ? size_t(ver - sym) : strlen(sym)).c_str(), ver ? ver + 1 : NULL); // 1 copy of "_name"
+    if (ptr && prefix < 0)
+        sym_prefix.store(1, ::std::memory_order_relaxed);
     return ptr;
 }
 
+namespace internal {
+#if defined(RTLD_DEFAULT) && (__ELF__+0) && !(__BIONIC__+0) && !(CAPI_TARGET_OS_MAC+0)
+# define CAPI_HAS_LINK_MAP 1
+static inline const link_map* link_map_from_handle(void* handle)
+{
+    if (!handle)
+        return NULL;
+    const link_map* m = static_cast<const link_map*>(handle);
+# if defined(__FreeBSD__)
+    if (dlinfo(handle, RTLD_DI_LINKMAP, &m) < 0)
+        m = NULL;
+# endif
+    return m;
+}
+#endif
+#if (CAPI_HAS_LINK_MAP+0) && defined(ElfW)
+# define CAPI_HAS_ELF_SYMBOLS 1
+/*!
+ * find symbols defined in a loaded ELF object by DT_GNU_HASH directly. no dlsym lock, error string and search in dependencies.
+ * dynamic section is parsed once in ctor. ifunc, tls and symbols not in the object are not found, use dlsym for them
+ */
+class elf_symbols {
+    ElfW(Addr) base;
+    const ElfW(Sym)* symtab;
+    const char* strtab;
+    const ElfW(Half)* versym;
+    const uint32_t* gnu_hash;
+public:
+    elf_symbols(const link_map* m) : base(0), symtab(NULL), strtab(NULL), versym(NULL), gnu_hash(NULL) {
+        if (!m || !m->l_ld)
+            return;
+        base = m->l_addr;
+        for (const ElfW(Dyn)* d = m->l_ld; d->d_tag != DT_NULL; ++d) {
+            // glibc relocates d_ptr except read-only dynamic section(mips, riscv), musl does not
+            const ElfW(Addr) p = d->d_un.d_ptr < base ? base + d->d_un.d_ptr : d->d_un.d_ptr;
+            switch (d->d_tag) {
+            case DT_GNU_HASH: gnu_hash = reinterpret_cast<const uint32_t*>(p); break;
+            case DT_SYMTAB: symtab = reinterpret_cast<const ElfW(Sym)*>(p); break;
+            case DT_STRTAB: strtab = reinterpret_cast<const char*>(p); break;
+            case DT_VERSYM: versym = reinterpret_cast<const ElfW(Half)*>(p); break;
+            default: break;
+            }
+        }
+        if (!symtab || !strtab || (gnu_hash && (!gnu_hash[0] || !gnu_hash[2])))
+            gnu_hash = NULL;
+    }
+    bool isValid() const { return !!gnu_hash;}
+    void* lookup(const char* name) const {
+        if (!gnu_hash)
+            return NULL;
+        uint32_t h = 5381;
+        for (const unsigned char* c = reinterpret_cast<const unsigned char*>(name); *c; ++c)
+            h = (h << 5) + h + *c;
+        enum { kBits = sizeof(ElfW(Addr))*8 };
+        const uint32_t nbuckets = gnu_hash[0], symoffset = gnu_hash[1], bloom_size = gnu_hash[2], bloom_shift = gnu_hash[3];
+        const ElfW(Addr)* bloom = reinterpret_cast<const ElfW(Addr)*>(gnu_hash + 4);
+        const uint32_t* buckets = reinterpret_cast<const uint32_t*>(bloom + bloom_size);
+        const uint32_t* chain = buckets + nbuckets - symoffset;
+        const ElfW(Addr) mask = (ElfW(Addr)(1) << (h % kBits)) | (ElfW(Addr)(1) << ((h >> bloom_shift) % kBits));
+        if ((bloom[(h / kBits) % bloom_size] & mask) != mask)
+            return NULL;
+        uint32_t i = buckets[h % nbuckets];
+        if (i < symoffset)
+            return NULL;
+        for (;; ++i) {
+            const uint32_t h2 = chain[i];
+            if ((h|1) == (h2|1) && match(i, name))
+                return reinterpret_cast<void*>(base + symtab[i].st_value);
+            if (h2 & 1)
+                return NULL;
+        }
+    }
+private:
+    bool match(uint32_t i, const char* name) const {
+        const ElfW(Sym)& s = symtab[i];
+        if (s.st_shndx == SHN_UNDEF || !s.st_value)
+            return false;
+        const int type = s.st_info & 0xf;
+        if (type != STT_FUNC && type != STT_OBJECT && type != STT_NOTYPE) // STT_GNU_IFUNC, STT_TLS
+            return false;
+        if ((s.st_info >> 4) == STB_LOCAL)
+            return false;
+        if (versym && (versym[i] & 0x8000)) // hidden version, not the default one dlsym returns
+            return false;
+        return strcmp(strtab + s.st_name, name) == 0;
+    }
+};
+#if (CAPI_HAS_ELF_SYMBOLS+0)
+# define CAPI_HAS_SYMBOL_CACHE 1
+// address range and build-id of a loaded ELF object
+struct elf_object {
+    ElfW(Addr) base, begin, end;
+    unsigned char build_id[64];
+    int build_id_len;
+    elf_object(const link_map* m) : base(m ? m->l_addr : 0), begin(0), end(0), build_id_len(0) {
+        if (m)
+            dl_iterate_phdr(callback, this);
+    }
+    bool contains(const void* p) const { return ElfW(Addr)(p) >= begin && ElfW(Addr)(p) < end;}
+private:
+    static int callback(struct dl_phdr_info* info, size_t, void* data) {
+        elf_object* o = static_cast<elf_object*>(data);
+        if (info->dlpi_addr != o->base)
+            return 0;
+        for (int i = 0; i < info->dlpi_phnum; ++i) {
+            const ElfW(Phdr)& ph = info->dlpi_phdr[i];
+            const ElfW(Addr) a = info->dlpi_addr + ph.p_vaddr;
+            if (ph.p_type == PT_LOAD) {
+                if (!o->begin || a < o->begin)
+                    o->begin = a;
+                if (a + ph.p_memsz > o->end)
+                    o->end = a + ph.p_memsz;
+            } else if (ph.p_type == PT_NOTE && !o->build_id_len) {
+                for (ElfW(Addr) n = a; n + sizeof(ElfW(Nhdr)) <= a + ph.p_memsz;) {
+                    const ElfW(Nhdr)* nh = reinterpret_cast<const ElfW(Nhdr)*>(n);
+                    const char* name = reinterpret_cast<const char*>(nh + 1);
+                    const unsigned char* desc = reinterpret_cast<const unsigned char*>(name + ((nh->n_namesz + 3) & ~3));
+                    if (nh->n_type == NT_GNU_BUILD_ID && nh->n_namesz == 4 && memcmp(name, "GNU", 4) == 0 && nh->n_descsz <= sizeof(o->build_id)) {
+                        memcpy(o->build_id, desc, nh->n_descsz);
+                        o->build_id_len = nh->n_descsz;
+                        break;
+                    }
+                    n = ElfW(Addr)(desc + ((nh->n_descsz + 3) & ~3));
+                }
+            }
+        }
+        return 1;
+    }
+};
+#endif //(CAPI_HAS_ELF_SYMBOLS+0)
+// read a byte of every page of readable PT_LOAD segments in the file, so they are mapped before the first calls
+inline int page_in_segments(struct dl_phdr_info* info, size_t, void* data) {
+    if (info->dlpi_addr != static_cast<const link_map*>(data)->l_addr)
+        return 0;
+    const long page = sysconf(_SC_PAGESIZE);
+    unsigned char sum = 0;
+    for (int i = 0; i < info->dlpi_phnum; ++i) {
+        const ElfW(Phdr)& ph = info->dlpi_phdr[i];
+        if (ph.p_type != PT_LOAD || !(ph.p_flags & PF_R))
+            continue;
+        const ElfW(Addr) begin = (info->dlpi_addr + ph.p_vaddr) & ~ElfW(Addr)(page - 1);
+        for (ElfW(Addr) a = begin; a < info->dlpi_addr + ph.p_vaddr + ph.p_filesz; a += page)
+            sum += *reinterpret_cast<const volatile unsigned char*>(a);
+    }
+    (void)sum;
+    return 1;
+}
+// page in the object and objects in its DT_NEEDED dependency chain
+inline void page_in(void* handle) {
+    const link_map* maps[128];
+    int n = 0;
+    maps[n++] = link_map_from_handle(handle);
+# if defined(RTLD_DI_LMID)
+    Lmid_t lmid = LM_ID_BASE;
+    dlinfo(handle, RTLD_DI_LMID, &lmid);
+# endif
+    for (int i = 0; i < n; ++i) {
+        if (!maps[i] || !maps[i]->l_ld)
+            continue;
+        dl_iterate_phdr(page_in_segments, const_cast<link_map*>(maps[i]));
+        const char* strtab = NULL;
+        const ElfW(Addr) base = maps[i]->l_addr;
+        for (const ElfW(Dyn)* d = maps[i]->l_ld; d->d_tag != DT_NULL; ++d) {
+            if (d->d_tag == DT_STRTAB)
+                strtab = reinterpret_cast<const char*>(d->d_un.d_ptr < base ? base + d->d_un.d_ptr : d->d_un.d_ptr);
+        }
+        for (const ElfW(Dyn)* d = maps[i]->l_ld; strtab && d->d_tag != DT_NULL; ++d) {
+            if (d->d_tag != DT_NEEDED)
+                continue;
+# if defined(RTLD_DI_LMID)
+            void* h = ::dlmopen(lmid, strtab + d->d_un.d_val, RTLD_LAZY|RTLD_NOLOAD);
+# else
+            void* h = ::dlopen(strtab + d->d_un.d_val, RTLD_LAZY|RTLD_NOLOAD);
+# endif
+            if (!h)
+                continue;
+            const link_map* m = link_map_from_handle(h);
+            bool found = false;
+            for (int j = 0; j < n && !found; ++j)
+                found = maps[j] == m;
+            if (!found && n < (int)(sizeof(maps)/sizeof(maps[0])))
+                maps[n++] = m;
+            ::dlclose(h); // still loaded by the dependent object
+        }
+    }
+}
+#if (CAPI_HAS_ELF_SYMBOLS+0)
+/*!
+ * symbol offset cache file "dir/<build-id>-<hash of symbol list>" is a header followed by an int64 offset from load address for each symbol.
+ * offset -1 means the symbol is not found in the symbol table of the object, it's resolved by name. e.g. in a dependency, not found,
+ * or an ifunc whose implementation depends on the cpu, so a cache dir can be shared by hosts of different hwcaps.
+ */
+class symbol_cache {
+    struct header {
+        char magic[4];
+        uint16_t version;
+        uint16_t ptr_size;
+        uint32_t count;
+        uint32_t build_id_len;
+        uint64_t names_hash;
+        unsigned char build_id[64];
+    };
+    char file[512+160];
+    header h;
+public:
+    symbol_cache(const elf_object& o, const char* const* syms, int n) {
+        file[0] = 0;
+        const char* dir = cache_dir();
+        if (!dir[0] || !o.build_id_len)
+            return;
+        memset(&h, 0, sizeof(h));
+        memcpy(h.magic, "capi", 4);
+        h.version = 2; // 1 cached dlsym results
+        h.ptr_size = sizeof(void*);
+        h.count = n;
+        h.build_id_len = o.build_id_len;
+        memcpy(h.build_id, o.build_id, o.build_id_len);
+        h.names_hash = names_hash(syms, n);
+        int len = CAPI_SNPRINTF(file, sizeof(file), "%s/", dir);
+        for (int i = 0; i < o.build_id_len && len > 0 && len < (int)sizeof(file); ++i)
+            len += CAPI_SNPRINTF(file + len, sizeof(file) - len, "%02x", o.build_id[i]);
+        if (len <= 0 || len >= (int)sizeof(file) || CAPI_SNPRINTF(file + len, sizeof(file) - len, "-%016llx", (unsigned long long)h.names_hash) >= (int)sizeof(file) - len)
+            file[0] = 0;
+    }
+    bool enabled() const { return !!file[0];}
+    // fill addrs if cache file matches. return the number of filled symbols, addrs[i] is null if it must be resolved by name
+    int load(ElfW(Addr) base, void** addrs) const {
+        if (!enabled())
+            return -1;
+        const int fd = ::open(file, O_RDONLY);
+        if (fd < 0)
+            return -1;
+        struct stat st;
+        const size_t size = sizeof(h) + h.count*sizeof(int64_t);
+        void* p = MAP_FAILED;
+        if (::fstat(fd, &st) == 0 && size_t(st.st_size) == size)
+            p = ::mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+        if (p == MAP_FAILED)
+            return -1;
+        int filled = -1;
+        if (memcmp(p, &h, sizeof(h)) == 0) {
+            const int64_t* offsets = reinterpret_cast<const int64_t*>(static_cast<const char*>(p) + sizeof(h));
+            filled = 0;
+            for (uint32_t i = 0; i < h.count; ++i) {
+                addrs[i] = offsets[i] < 0 ? NULL : reinterpret_cast<void*>(base + offsets[i]);
+                if (addrs[i])
+                    ++filled;
+            }
+        }
+        ::munmap(p, size);
+        return filled;
+    }
+    // offsets of symbols found in the symbol table(in_table[i] is not 0), others are -1
+    void save(const elf_object& o, void* const* addrs, const unsigned char* in_table) const {
+        if (!enabled())
+            return;
+        ::mkdir(cache_dir(), 0755);
+        char tmp[sizeof(file) + 16];
+        CAPI_SNPRINTF(tmp, sizeof(tmp), "%s.%d", file, (int)::getpid());
+        FILE* f = fopen(tmp, "wb");
+        if (!f)
+            return;
+        fwrite(&h, sizeof(h), 1, f);
+        for (uint32_t i = 0; i < h.count; ++i) {
+            const int64_t offset = in_table[i] && o.contains(addrs[i]) ? int64_t(ElfW(Addr)(addrs[i]) - o.base) : -1;
+            fwrite(&offset, sizeof(offset), 1, f);
+        }
+        if (fclose(f) != 0 || rename(tmp, file) != 0)
+            remove(tmp);
+    }
+};
+#endif
+#else
+inline void page_in(void*) {}
+#endif
+} //namespace internal
+
+void setProbeCacheFile(const char* path) {
+#if (CAPI_HAS_PROBE_CACHE+0)
+    CAPI_SNPRINTF(internal::probe_cache::fileName(), 512, "%s", path ? path : "");
+#else
+    (void)path;
+#endif
+}
+
+void setSymbolCacheDir(const char* dir) {
+#if (CAPI_HAS_CACHE_DIR+0)
+    CAPI_SNPRINTF(internal::cache_dir_setting(), 512, "%s", dir ? dir : "");
+#else
+    (void)dir;
+#endif
+}
+
+int dso::resolve(const char* const* syms, void** addrs, int n) {
+    if (!handle) {
+        memset(addrs, 0, n*sizeof(void*));
+        return 0;
+    }
+#if (CAPI_HAS_ELF_SYMBOLS+0)
+    const link_map* m = internal::link_map_from_handle(handle);
+# if (CAPI_HAS_SYMBOL_CACHE+0)
+    const internal::elf_object obj(m);
+    const internal::symbol_cache cache(obj, syms, n);
+    const int cached = cache.load(obj.base, addrs);
+    if (cached >= 0) {
+        CAPI_DBG_RESOLVE("dso.resolve: %d/%d symbols from cache", cached, n);
+    }
+# else
+    const int cached = -1;
+# endif
+    const internal::elf_symbols elf(cached < 0 ? m : NULL);
+#else
+    const int cached = -1;
+#endif
+#if (CAPI_HAS_SYMBOL_CACHE+0)
+    unsigned char* in_table = cached < 0 && cache.enabled() ? new unsigned char[n]() : NULL; // only these offsets are cached
+#endif
+    int resolved = 0;
+    for (int i = 0; i < n; ++i) {
+        void* p = cached < 0 ? NULL : addrs[i];
+#if (CAPI_HAS_ELF_SYMBOLS+0)
+        if (!p && cached < 0)
+            p = elf.lookup(syms[i]);
+# if (CAPI_HAS_SYMBOL_CACHE+0)
+        if (p && in_table)
+            in_table[i] = 1;
+# endif
+#endif
+        if (!p) // ifunc, tls, symbols in dependencies or not found
+            p = dso::resolve(syms[i]);
+        CAPI_DBG_RESOLVE("dso.resolve(\"%s\"): %p", syms[i], p);
+        addrs[i] = p;
+        if (p)
+            ++resolved;
+    }
+#if (CAPI_HAS_SYMBOL_CACHE+0)
+    if (in_table)
+        cache.save(obj, addrs, in_table);
+    delete [] in_table;
+#endif
+    return resolved;
+}
+
 #if defined(RTLD_DEFAULT) && defined(__ELF__) && (__BIONIC__+0) // android only now
 struct path_string {
     char* path;
@@ -493,13 +2847,9 @@ _Pragma("weak dl_iterate_phdr") // arm: api21+
     const soinfo* si = reinterpret_cast<soinfo*>(intptr_t(handle)+offset);
     if (dladdr && dladdr(si, &info))
         CAPI_SNPRINTF(path, path_len, "%s", info.dli_fname);
-#elif defined(RTLD_DEFAULT) // check (0+__USE_GNU+__ELF__)? weak dlinfo? // mac, mingw, cygwin has no dlinfo
-    const link_map* m = static_cast<const link_map*>(handle);
-# if defined(__FreeBSD__)
-    if (dlinfo(handle, RTLD_DI_LINKMAP, &m) < 0)
-        m = NULL;
-# endif
-    if (m->l_name && m->l_name[0])
+#elif (CAPI_HAS_LINK_MAP+0) // check (0+__USE_GNU+__ELF__)? weak dlinfo? // mac, mingw, cygwin has no dlinfo
+    const link_map* m = internal::link_map_from_handle(handle);
+    if (m && m->l_name && m->l_name[0])
         CAPI_SNPRINTF(path, path_len, "%s", m->l_name);
 #endif
     return path;
@@ -519,17 +2869,52 @@ _Pragma("weak dl_iterate_phdr") // arm: api21+
 #define CAPI_DEFINE_X(R, name, ARG_T, ARG_T_V, ARG_V) \
     CAPI_DEFINE_T_V(R, name, ARG_T, ARG_T_V, ARG_V) \
     CAPI_NS_DEFINE_T_V(R, name, ARG_T, ARG_T_V, ARG_V)
-/* declare and define the symbol resolvers*/
 #define EMPTY_LINKAGE
-#define CAPI_DEFINE_RESOLVER_X(R, name, sym, ARG_T, ARG_T_V, ARG_V) CAPI_DEFINE_M_RESOLVER_T_V(R, EMPTY_LINKAGE, name, sym, ARG_T, ARG_T_V, ARG_V)
-// api with linkage modifier
-#define CAPI_DEFINE_M_RESOLVER_X(R, M, name, sym, ARG_T, ARG_T_V, ARG_V) CAPI_DEFINE_M_RESOLVER_T_V(R, M, name, sym, ARG_T, ARG_T_V, ARG_V)
 
 #define CAPI_DEFINE2_X(R, name, sym, ARG_T, ARG_T_V, ARG_V) \
     CAPI_DEFINE2_T_V(R, name, sym, ARG_T, ARG_T_V, ARG_V) \
     CAPI_NS_DEFINE2_T_V(R, name, sym, ARG_T, ARG_T_V, ARG_V)
+/*!
+ * define a ::capi::function declared in header, after CAPI_DEFINE_DLL. it calls the entry of the same name declared in CAPI_BEGIN_DLL*,
+ * so the symbol and version are the entry's, e.g. of CAPI_DEFINE_VER_ENTRY
+ */
+#if CAPI_IS(RELOAD)
+#define CAPI_DEFINE_FUNCTION(name) static_assert(false, "::capi::function does not support CAPI_IS_RELOAD");
+#else
+#define CAPI_DEFINE_FUNCTION(name) \
+    namespace capi { \
+    decltype(name) name(#name, CAPI_ENTRY_INDEX(name), &::capi::internal::function_ops<api_dll>::table); \
+    }
+#endif
+/*!
+ * define namespace style companions of an api defined by CAPI_DEFINE, declared in header:
+ *   std::future<R> name_async(args...): run the call in ::capi::call_queue::instance()
+ *   std::function<R()> name_bind(args...): the call with bound arguments, to submit with a completion callback or in a ::capi::call_queue::batch
+ * e.g. CAPI_DEFINE_ASYNC(const char*, zError, CAPI_ARG1(int))
+ */
+#define CAPI_DEFINE_ASYNC(R, name, ...) CAPI_EXPAND(CAPI_DEFINE_ASYNC_T_V(R, name, __VA_ARGS__))
+#define CAPI_DEFINE_ASYNC_T_V(R, name, ARG_T, ARG_T_V, ARG_V) \
+    namespace capi { \
+        ::std::function<R()> name##_bind ARG_T_V { return [=] { return name ARG_V;};} \
+        ::std::future<R> name##_async ARG_T_V { return ::capi::call_queue::instance().submit(name##_bind ARG_V);} \
+    }
 #define CAPI_DEFINE_ENTRY_X(R, name, sym, ARG_T, ARG_T_V, ARG_V) CAPI_DEFINE_M_ENTRY_X(R, EMPTY_LINKAGE, name, sym, ARG_T, ARG_T_V, ARG_V)
-#define CAPI_DEFINE_M_ENTRY_X(R, M, sym, name, ARG_T, ARG_T_V, ARG_V) typedef R (M *name##_t) ARG_T; name##_t name;
+#define CAPI_DEFINE_M_ENTRY_X(R, M, name, sym, ARG_T, ARG_T_V, ARG_V) CAPI_DEFINE_M_ENTRY_HOT_X(R, M, name, sym, false, ARG_T, ARG_T_V, ARG_V)
+#define CAPI_DEFINE_M_ENTRY_HOT_X(R, M, name, sym, hot, ARG_T, ARG_T_V, ARG_V) CAPI_DEFINE_M_ENTRY_HOT_S(R, M, name, #sym, hot, ARG_T, ARG_T_V, ARG_V)
+// s: symbol string, "name" or "name@VERSION"
+#if CAPI_IS(TRAMPOLINE)
+#define CAPI_DEFINE_M_ENTRY_HOT_S(R, M, name, s, hot, ARG_T, ARG_T_V, ARG_V) \
+    typedef R (M *name##_t) ARG_T; \
+    static R M name##_stub ARG_T_V { \
+        name##_t f = ::capi::internal::patch(api_dll::api.name, (name##_t)api_dll::instance()->resolve(s)); \
+        CAPI_DBG_RESOLVE("dll::api_t::" #name ": @%p", f); \
+        assert(f && "failed to resolve " #R " " s #ARG_T_V); \
+        return f ARG_V; \
+    } \
+    typename P::template entry<name##_t> name{P::init(s, hot, &name##_stub)};
+#else
+#define CAPI_DEFINE_M_ENTRY_HOT_S(R, M, name, s, hot, ARG_T, ARG_T_V, ARG_V) typedef R (M *name##_t) ARG_T; typename P::template entry<name##_t> name{P::init(s, hot)};
+#endif
 
 #define CAPI_ARG0() (), (), ()
 #define CAPI_ARG1(P1) (P1), (P1 p1), (p1)
@@ -0,0 +1,126 @@
+/******************************************************************************
+    A benchmark of CAPI load and resolve with a generated library of many symbols
+    Copyright (C) 2014 Wang Bin <wbsecg1@gmail.com>
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+******************************************************************************/
+// libstub.so* and stub_api.* are generated by stubgen, see CMakeLists.txt.
+// 1 json object per line like zlib_bench: {"bench":..., "symbols":..., "ns":...}. times are in ns
+// usage: stub_bench [file to append results to, default is stdout]
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <vector>
+#include "capi.h"
+#include "stub_api.h"
+
+typedef std::chrono::steady_clock clock_type;
+static int64_t ns_since(clock_type::time_point t0) {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(clock_type::now() - t0).count();
+}
+static volatile uintptr_t sink;
+
+static void print(const char* bench, int n, double ns) {
+    printf("{\"bench\":\"%s\",\"symbols\":%d,\"ns\":%.3f}\n", bench, n, ns);
+    fflush(stdout);
+}
+
+static std::vector<const char*> symbol_names(const char* prefix, std::vector<std::string>& buf) {
+    buf.resize(STUB_SYMBOLS);
+    std::vector<const char*> names(STUB_SYMBOLS);
+    char s[64];
+    for (int i = 0; i < STUB_SYMBOLS; ++i) {
+        CAPI_SNPRINTF(s, sizeof(s), "%s_%d", prefix, i);
+        buf[i] = s;
+        names[i] = buf[i].c_str();
+    }
+    return names;
+}
+
+int main(int argc, char** argv)
+{
+    if (argc > 1 && !freopen(argv[1], "a", stdout))
+        return 1;
+    const int n = STUB_SYMBOLS;
+    std::vector<std::string> buf, miss_buf;
+    const std::vector<const char*> names = symbol_names("stub", buf);
+    const std::vector<const char*> misses = symbol_names("nostub", miss_buf);
+    ::capi::dso d;
+    d.setFileName("stub");
+    clock_type::time_point t0 = clock_type::now();
+    if (!d.load(false)) {
+        fprintf(stderr, "can not load libstub.so\n");
+        return 1;
+    }
+    print("dso_load", n, double(ns_since(t0)));
+    t0 = clock_type::now();
+    for (int i = 0; i < n; ++i)
+        sink = (uintptr_t)d.resolve(names[i]);
+    print("dso_resolve", n, double(ns_since(t0))/n);
+    t0 = clock_type::now();
+    for (int i = 0; i < n; ++i)
+        sink = (uintptr_t)d.resolve(misses[i]);
+    print("dso_resolve_miss", n, double(ns_since(t0))/n);
+    // repeated lookups of the same names with ResolveCache. the 1st pass fills the cache
+    ::capi::dso c;
+    c.setFileName("stub");
+    c.setLoadFlags(::capi::ResolveCache);
+    c.load(false);
+    const int cached = std::min(n, CAPI_RESOLVE_CACHE_SIZE/4); // names and misses fill half of the cache
+    for (int i = 0; i < cached; ++i) {
+        if (c.resolve(names[i]) != d.resolve(names[i])) {
+            fprintf(stderr, "wrong cached address of %s\n", names[i]);
+            return 1;
+        }
+        sink = (uintptr_t)c.resolve(misses[i]);
+    }
+    t0 = clock_type::now();
+    for (int i = 0; i < cached; ++i)
+        sink = (uintptr_t)c.resolve(names[i]);
+    print("dso_resolve_cached", cached, double(ns_since(t0))/cached);
+    t0 = clock_type::now();
+    for (int i = 0; i < cached; ++i)
+        sink = (uintptr_t)c.resolve(misses[i]);
+    print("dso_resolve_miss_cached", cached, double(ns_since(t0))/cached);
+    std::vector<void*> addrs(n);
+    t0 = clock_type::now();
+    const int resolved = d.resolve(&names[0], &addrs[0], n);
+    print("dso_resolve_batch", n, double(ns_since(t0))/n);
+    if (resolved != n) {
+        fprintf(stderr, "resolved %d/%d symbols\n", resolved, n);
+        return 1;
+    }
+    // probe libstub.so.3(missing), libstub.so.2
+    static const char* lib[] = { "stub", NULL };
+    static const int versions[] = { 3, 2, 1, ::capi::NoVersion, ::capi::EndVersion };
+    const int loads = 100;
+    t0 = clock_type::now();
+    for (int i = 0; i < loads; ++i) {
+        ::capi::internal::dll_helper< ::capi::dso> h(lib, versions);
+        sink = h.isLoaded();
+    }
+    print(getenv("CAPI_PROBE_CACHE") ? "probe_cached" : "probe", n, double(ns_since(t0))/loads);
+    // the generated wrapper loads libstub.so.2, and resolves all entries in 1 pass
+    t0 = clock_type::now();
+    stub::capi::preload(true).get();
+    print("api_load_resolve_all", n, double(ns_since(t0)));
+    if (stub::capi::stub_soversion() != 2 || stub::capi::stub_1(1) != 2 || stub::capi::stub_0(1) != -1) { // stub_0 is versioned, the entry is the old version
+        fprintf(stderr, "wrong results of generated functions\n");
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,200 @@
+/******************************************************************************
+    stubgen: generate a synthetic C library with many functions and its CAPI wrapper
+    Copyright (C) 2014 Wang Bin <wbsecg1@gmail.com>
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+******************************************************************************/
+/*
+ * usage: stubgen [-name stub] [-n 1000] [-versioned K] [-underscore] [-sonames 2,1] [-style define|function] [-o dir]
+ * output in dir:
+ *  name.c: int name_i(int x) { return x + i; }, i = 0...n-1, and int name_soversion() returns the macro NAME_SOVERSION
+ *   -versioned K: name_i of i%K == 0 has 2 versions, name_i@NAME_1.0 returns -(x + i), and the default name_i@@NAME_2.0
+ *   -underscore: _name_i are exported too
+ *  name.map: version script, versions are used if -versioned
+ *  name_api.h, name_api.cpp: CAPI wrapper loading sonames(e.g. libname.so.2, libname.so.1) then libname.so.
+ *   entries of versioned functions are the old versions.
+ *   -style define: CAPI_DEFINE, class and namespace style. -style function: ::capi::function, namespace style only and faster to build
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <string>
+#include <vector>
+
+struct options {
+    std::string name, dir, upper;
+    int n, versioned;
+    bool underscore, function;
+    std::vector<int> sonames;
+    options() : name("stub"), dir("."), n(1000), versioned(0), underscore(false), function(false) {}
+    bool isVersioned(int i) const { return versioned > 0 && i % versioned == 0;}
+};
+
+static FILE* open_file(const options& o, const char* suffix) {
+    const std::string path = o.dir + "/" + o.name + suffix;
+    FILE* f = fopen(path.c_str(), "w");
+    if (!f)
+        fprintf(stderr, "stubgen: can not open %s\n", path.c_str());
+    return f;
+}
+
+static bool gen_c(const options& o) {
+    FILE* f = open_file(o, ".c");
+    if (!f)
+        return false;
+    const char* s = o.name.c_str();
+    fprintf(f, "/* generated by stubgen. do not edit */\n");
+    fprintf(f, "#ifndef %s_SOVERSION\n#define %s_SOVERSION 0\n#endif\n", o.upper.c_str(), o.upper.c_str());
+    fprintf(f, "#define EXPORT __attribute__((visibility(\"default\")))\n");
+    fprintf(f, "EXPORT int %s_soversion(void) { return %s_SOVERSION; }\n", s, o.upper.c_str());
+    for (int i = 0; i < o.n; ++i) {
+        fprintf(f, "EXPORT int %s_%d(int x) { return x + %d; }\n", s, i, i);
+        if (o.underscore)
+            fprintf(f, "EXPORT int _%s_%d(int x) { return x + %d; }\n", s, i, i);
+        if (o.isVersioned(i)) {
+            fprintf(f, "EXPORT int %s_%d_v1(int x) { return -(x + %d); }\n", s, i, i);
+            fprintf(f, "__asm__(\".symver %s_%d_v1, %s_%d@%s_1.0\");\n", s, i, s, i, o.upper.c_str());
+        }
+    }
+    fclose(f);
+    f = open_file(o, ".map");
+    if (!f)
+        return false;
+    if (o.versioned)
+        fprintf(f, "%s_1.0 { };\n%s_2.0 { global: *; } %s_1.0;\n", o.upper.c_str(), o.upper.c_str(), o.upper.c_str());
+    else
+        fprintf(f, "{ global: *; };\n");
+    fclose(f);
+    return true;
+}
+
+static bool gen_header(const options& o) {
+    FILE* f = open_file(o, "_api.h");
+    if (!f)
+        return false;
+    const char* s = o.name.c_str();
+    const char* S = o.upper.c_str();
+    fprintf(f, "// generated by stubgen. do not edit\n#ifndef %s_API_H\n#define %s_API_H\n#include <future>\n", S, S);
+    if (o.function)
+        fprintf(f, "#include \"capi.h\"\n");
+    fprintf(f, "namespace %s {\nnamespace capi {\n", s);
+    fprintf(f, "bool loaded();\nstd::shared_future<bool> preload(bool resolve = false);\n");
+    if (o.function) {
+        fprintf(f, "extern ::capi::function<int()> %s_soversion;\n", s);
+        for (int i = 0; i < o.n; ++i)
+            fprintf(f, "extern ::capi::function<int(int)> %s_%d;\n", s, i);
+        fprintf(f, "} //namespace capi\n} //namespace %s\n#endif\n", s);
+        fclose(f);
+        return true;
+    }
+    fprintf(f, "int %s_soversion();\n", s);
+    for (int i = 0; i < o.n; ++i) {
+        fprintf(f, "int %s_%d(int);\n", s, i);
+        if (o.isVersioned(i))
+            fprintf(f, "bool has_%s_%d();\n", s, i);
+    }
+    fprintf(f, "} //namespace capi\nclass api_dll;\nclass api\n{\n    api_dll *dll;\npublic:\n    api();\n    virtual ~api();\n    virtual bool loaded() const;\n");
+    fprintf(f, "#ifndef %s_CAPI_NS\n    int %s_soversion();\n", S, s);
+    for (int i = 0; i < o.n; ++i) {
+        fprintf(f, "    int %s_%d(int);\n", s, i);
+        if (o.isVersioned(i))
+            fprintf(f, "    bool has_%s_%d() const;\n", s, i);
+    }
+    fprintf(f, "#endif\n};\n} //namespace %s\n#endif\n", s);
+    fclose(f);
+    return true;
+}
+
+static bool gen_source(const options& o) {
+    FILE* f = open_file(o, "_api.cpp");
+    if (!f)
+        return false;
+    const char* s = o.name.c_str();
+    const char* S = o.upper.c_str();
+    fprintf(f, "// generated by stubgen. do not edit\n#include \"capi.h\"\n#include \"%s_api.h\"\nnamespace %s {\n", s, s);
+    fprintf(f, "static const char* names[] = { \"%s\", NULL };\nstatic const int versions[] = { ", s);
+    for (size_t i = 0; i < o.sonames.size(); ++i)
+        fprintf(f, "%d, ", o.sonames[i]);
+    fprintf(f, "::capi::NoVersion, ::capi::EndVersion };\n");
+    fprintf(f, "CAPI_BEGIN_DLL_VER(names, versions, ::capi::dso)\n");
+    fprintf(f, "CAPI_DEFINE_ENTRY(int, %s_soversion, CAPI_ARG0())\n", s);
+    for (int i = 0; i < o.n; ++i) {
+        if (o.isVersioned(i))
+            fprintf(f, "CAPI_DEFINE_VER_ENTRY(int, %s_%d, \"%s_1.0\", CAPI_ARG1(int))\n", s, i, S);
+        else
+            fprintf(f, "CAPI_DEFINE_ENTRY(int, %s_%d, CAPI_ARG1(int))\n", s, i);
+    }
+    fprintf(f, "CAPI_END_DLL()\n");
+    if (o.function) {
+        fprintf(f, "CAPI_DEFINE_NS_DLL\nCAPI_DEFINE_FUNCTION(%s_soversion)\n", s);
+        for (int i = 0; i < o.n; ++i)
+            fprintf(f, "CAPI_DEFINE_FUNCTION(%s_%d)\n", s, i); // versions are of the entries
+    } else {
+        fprintf(f, "CAPI_DEFINE_DLL\nCAPI_DEFINE(int, %s_soversion, CAPI_ARG0())\n", s);
+        for (int i = 0; i < o.n; ++i) {
+            fprintf(f, "CAPI_DEFINE(int, %s_%d, CAPI_ARG1(int))\n", s, i);
+            if (o.isVersioned(i))
+                fprintf(f, "CAPI_DEFINE_HAS(%s_%d)\n", s, i);
+        }
+    }
+    fprintf(f, "} //namespace %s\n", s);
+    fclose(f);
+    return true;
+}
+
+int main(int argc, char** argv)
+{
+    options o;
+    for (int i = 1; i < argc; ++i) {
+        const char* a = argv[i];
+        const char* v = i + 1 < argc ? argv[i + 1] : "";
+        if (!strcmp(a, "-name")) {
+            o.name = v;
+            ++i;
+        } else if (!strcmp(a, "-n")) {
+            o.n = atoi(v);
+            ++i;
+        } else if (!strcmp(a, "-versioned")) {
+            o.versioned = atoi(v);
+            ++i;
+        } else if (!strcmp(a, "-underscore")) {
+            o.underscore = true;
+        } else if (!strcmp(a, "-sonames")) {
+            for (const char* p = v; *p; ) {
+                o.sonames.push_back(atoi(p));
+                p = strchr(p, ',');
+                if (!p)
+                    break;
+                ++p;
+            }
+            ++i;
+        } else if (!strcmp(a, "-style")) {
+            o.function = !strcmp(v, "function");
+            ++i;
+        } else if (!strcmp(a, "-o")) {
+            o.dir = v;
+            ++i;
+        } else {
+            fprintf(stderr, "usage: %s [-name stub] [-n 1000] [-versioned K] [-underscore] [-sonames 2,1] [-style define|function] [-o dir]\n", argv[0]);
+            return 1;
+        }
+    }
+    for (size_t i = 0; i < o.name.size(); ++i)
+        o.upper += (char)toupper((unsigned char)o.name[i]);
+    if (!gen_c(o) || !gen_header(o) || !gen_source(o))
+        return 1;
+    return 0;
+}
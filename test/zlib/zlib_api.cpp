@@ -17,7 +17,9 @@
     Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
 ******************************************************************************/
 #define ZLIB_CAPI_BUILD
+#ifndef NDEBUG // zlib_bench is built with NDEBUG
 #define DEBUG ////log dll load and symbol resolve
+#endif
 //#define CAPI_IS_LAZY_RESOLVE 0 //define it will resolve all symbols in constructor
 #ifndef CAPI_LINK_ZLIB
 // Need a library loader/resolver class whose function names like QLibrary. You can use ::capi::dso
@@ -44,11 +46,13 @@ static const char* zlib[] = {
 static const int versions[] = { 0, ::capi::NoVersion, 1, ::capi::EndVersion };
 //CAPI_BEGIN_DLL(zlib, QLibrary)
 CAPI_BEGIN_DLL_VER(zlib, versions, ::capi::dso)
-CAPI_DEFINE_ENTRY(const char*, zlibVersion, CAPI_ARG0())
+CAPI_DEFINE_HOT_ENTRY(const char*, zlibVersion, CAPI_ARG0()) // hot entries first
 CAPI_DEFINE_ENTRY(const char*, zError, CAPI_ARG1(int))
 CAPI_END_DLL()
 CAPI_DEFINE_DLL
 CAPI_DEFINE(const char*, zlibVersion, CAPI_ARG0())
 CAPI_DEFINE(const char*, zError, CAPI_ARG1(int))
+CAPI_DEFINE_HAS(zError)
+CAPI_DEFINE_ASYNC(const char*, zError, CAPI_ARG1(int))
 #endif //CAPI_LINK_ZLIB
 } //namespace zlib
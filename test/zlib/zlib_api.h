@@ -19,6 +19,8 @@
 
 #ifndef ZLIB_API_H
 #define ZLIB_API_H
+#include <functional>
+#include <future>
 // no need to include the C header if only functions declared there
 #ifndef CAPI_LINK_ZLIB
 namespace zlib { //need a unique namespace
@@ -36,7 +38,18 @@ namespace zlib { //need a unique namespace
 #ifndef CAPI_LINK_ZLIB // avoid ambiguous in zlib_api.cpp
 using namespace capi;
 #endif
-namespace capi { bool loaded();} // For link or NS style. Or load test for class style. api.loaded for class style.
+namespace capi {
+bool loaded(); // For link or NS style. Or load test for class style. api.loaded for class style.
+std::shared_future<bool> preload(bool resolve = false); // load(and resolve all symbols) in background. loaded() and calls wait until it's finished
+#ifndef CAPI_LINK_ZLIB
+bool has_zError(); // whether the symbol is available, a bit test after the first query
+std::future<const char*> zError_async(int); // run in a worker thread
+std::function<const char*()> zError_bind(int); // for a completion callback or a batch of calls
+#if defined(CAPI_IS_RELOAD) && CAPI_IS_RELOAD
+bool reload(const char* path = nullptr); // load a new library for namespace style calls, see CAPI_IS_RELOAD in capi.h
+#endif
+#endif
+}
 class api_dll; //must use this name
 class api //must use this name
 {
@@ -48,6 +61,7 @@ public:
 #if !defined(CAPI_LINK_ZLIB) && !defined(ZLIB_CAPI_NS)
     const char* zlibVersion();
     const char* zError(int);
+    bool has_zError() const;
 #endif
 };
 } //namespace zlib
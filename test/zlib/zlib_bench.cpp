@@ -0,0 +1,127 @@
+/******************************************************************************
+    A benchmark of CAPI call overhead, first call latency, load time and multi-thread calls
+    Copyright (C) 2014 Wang Bin <wbsecg1@gmail.com>
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+******************************************************************************/
+// built once for each style and resolve mode by CMakeLists.txt, and run with libz of zstub.c, see the bench target.
+// 1 json object per line: {"style":..., "mode":..., "bench":..., ...}. times are in ns
+// usage: zlib_bench [calls per thread] [file to append results to, default is stdout]
+#ifdef ZLIB_BENCH_NS // not defined for zlib_api.cpp
+#define ZLIB_CAPI_NS
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include "capi.h"
+#include "zlib_api.h"
+
+#if defined(CAPI_LINK_ZLIB)
+static const char kStyle[] = "link";
+#elif defined(ZLIB_CAPI_NS)
+static const char kStyle[] = "namespace";
+#else
+static const char kStyle[] = "class";
+#endif
+#if defined(CAPI_LINK_ZLIB)
+static const char kMode[] = "link";
+#elif CAPI_IS(TRAMPOLINE)
+static const char kMode[] = "trampoline";
+#elif CAPI_IS(LAZY_RESOLVE)
+static const char kMode[] = "lazy";
+#else
+static const char kMode[] = "eager";
+#endif
+
+typedef std::chrono::steady_clock clock_type;
+static int64_t ns_since(clock_type::time_point t0) {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(clock_type::now() - t0).count();
+}
+static volatile uintptr_t sink; // keep the calls
+
+class caller
+#if !defined(ZLIB_CAPI_NS)
+        : protected zlib::api // class style calls, or zlib functions if CAPI_LINK_ZLIB
+#endif
+{
+public:
+    int64_t first() {
+        const clock_type::time_point t0 = clock_type::now();
+        sink = (uintptr_t)zlibVersion();
+        return ns_since(t0);
+    }
+    int64_t calls(int n) {
+        uintptr_t s = 0;
+        const clock_type::time_point t0 = clock_type::now();
+        for (int i = 0; i < n; ++i)
+            s += (uintptr_t)zlibVersion();
+        const int64_t t = ns_since(t0);
+        sink = s;
+        return t;
+    }
+};
+
+static void print(const char* bench, const char* extra, double ns) {
+    printf("{\"style\":\"%s\",\"mode\":\"%s\",\"bench\":\"%s\"%s,\"ns\":%.3f}\n", kStyle, kMode, bench, extra, ns);
+    fflush(stdout);
+}
+
+int main(int argc, char** argv)
+{
+    const int n = argc > 1 ? atoi(argv[1]) : 10000000;
+    if (argc > 2 && !freopen(argv[2], "a", stdout))
+        return 1;
+    // the first call including load in namespace style, and resolve in lazy mode
+    const clock_type::time_point t0 = clock_type::now();
+    caller c;
+    const int64_t ctor = ns_since(t0);
+    print("first_call", "", double(c.first() + ctor));
+    print("call", ",\"threads\":1", double(c.calls(n))/n);
+    // multi-thread calls. every thread has a class style object
+    const int max_threads = std::max(2, (int)std::thread::hardware_concurrency());
+    for (int threads = 2; threads <= max_threads; threads *= 2) {
+        std::vector<int64_t> t(threads);
+        std::vector<std::thread> workers;
+        const clock_type::time_point t1 = clock_type::now();
+        for (int i = 0; i < threads; ++i) {
+            workers.push_back(std::thread([&t, i, n] {
+                caller c;
+                t[i] = c.calls(n);
+            }));
+        }
+        for (int i = 0; i < threads; ++i)
+            workers[i].join();
+        const int64_t wall = ns_since(t1);
+        int64_t sum = 0;
+        for (int i = 0; i < threads; ++i)
+            sum += t[i];
+        char extra[64];
+        CAPI_SNPRINTF(extra, sizeof(extra), ",\"threads\":%d,\"calls_per_sec\":%.0f", threads, double(n)*threads*1e9/double(wall));
+        print("call", extra, double(sum)/threads/n);
+    }
+    // dll_helper load time, probing names x versions. the library is already loaded, so it's mostly the probe cost
+    static const char* names[] = { "capi_bench_none", "z", NULL };
+    static const int versions[] = { ::capi::NoVersion, 1, ::capi::EndVersion };
+    const int loads = 200;
+    const clock_type::time_point t2 = clock_type::now();
+    for (int i = 0; i < loads; ++i) {
+        ::capi::internal::dll_helper< ::capi::dso> h(names, versions);
+        sink = h.isLoaded();
+    }
+    print("load", ",\"names\":2,\"versions\":2", double(ns_since(t2))/loads);
+    return 0;
+}
@@ -0,0 +1,790 @@
+/******************************************************************************
+    Tests of CAPI features enabled by defines
+    Copyright (C) 2014 Wang Bin <wbsecg1@gmail.com>
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+******************************************************************************/
+// built once for each feature define by CMakeLists.txt, and run with libz of zstub.c by ctest.
+// zlib_api.cpp is included, so api_dll is visible to the tests
+// usage: zlib_mode_test [build directory of zstub]
+#include <stdio.h>
+#include <string.h>
+#include <dirent.h>
+#include <dlfcn.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "zlib_api.cpp"
+
+#define CHECK(expr) do { \
+        if (!(expr)) { \
+            printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #expr); \
+            return false; \
+        } \
+    } while (0)
+
+static const char kStubVersion[] = "1.2.11.stub"; // zlibVersion() of zstub.c
+
+static bool test_calls() {
+    zlib::api z;
+    CHECK(z.loaded());
+    CHECK(!strcmp(z.zlibVersion(), kStubVersion));
+    CHECK(!strcmp(z.zError(-2), "stream error"));
+    CHECK(z.has_zError());
+    CHECK(zlib::capi::loaded());
+    CHECK(!strcmp(zlib::capi::zlibVersion(), kStubVersion));
+    CHECK(zlib::capi::has_zError());
+    return true;
+}
+
+// runtime names are mapped to the compile time indices of entries in every table policy
+static bool test_entry_index() {
+    using zlib::api_dll;
+    CHECK(api_dll::entry_count == 2);
+    CHECK(CAPI_ENTRY_INDEX(zlibVersion) != CAPI_ENTRY_INDEX(zError));
+    CHECK(api_dll::entryIndex("zlibVersion") == CAPI_ENTRY_INDEX(zlibVersion));
+    CHECK(api_dll::entryIndex("zError") == CAPI_ENTRY_INDEX(zError));
+    for (int i = 0; i < api_dll::entry_count; ++i)
+        CHECK(api_dll::entryIndex(api_dll::symbols()[i]) == i);
+    CHECK(api_dll::entryIndex("zErro") == -1);
+    CHECK(api_dll::entryIndex("inflate") == -1);
+    CHECK(api_dll::entryIndex("") == -1);
+    return true;
+}
+
+// calls in worker threads by name_async(), and batches of bound calls with futures or completion callbacks
+static bool test_async() {
+    std::future<const char*> f = zlib::capi::zError_async(-2);
+    CHECK(!strcmp(f.get(), "stream error"));
+    std::vector<std::future<const char*> > results;
+    std::atomic<int> done(0);
+    {
+        ::capi::call_queue q(2);
+        ::capi::call_queue::batch b;
+        for (int e = -6; e <= 2; ++e)
+            results.push_back(b.add(zlib::capi::zError_bind(e)));
+        b.add(zlib::capi::zError_bind(-4), [&done](const char* msg) {
+            if (!strcmp(msg, "insufficient memory"))
+                ++done;
+        });
+        b.add([] {}, [&done] { ++done;});
+        CHECK(b.size() == 11);
+        q.submit(b);
+        CHECK(b.size() == 0);
+    } // queued calls are finished
+    CHECK(done == 2);
+    zlib::api z;
+    for (int e = -6; e <= 2; ++e)
+        CHECK(!strcmp(results[e + 6].get(), z.zError(e)));
+    return true;
+}
+
+// n calls of zlibVersion() in each of threads threads, class style in odd threads
+static void call_in_threads(int threads, int n) {
+    std::vector<std::thread> workers;
+    for (int i = 0; i < threads; ++i) {
+        workers.push_back(std::thread([i, n] {
+            zlib::api z;
+            for (int k = 0; k < n; ++k) {
+                if (i & 1)
+                    z.zlibVersion();
+                else
+                    zlib::capi::zlibVersion();
+            }
+        }));
+    }
+    for (int i = 0; i < threads; ++i)
+        workers[i].join();
+}
+
+#if CAPI_IS(STATS)
+static const ::capi::stats::entry* find(const ::capi::stats::snapshot& s, const char* name) {
+    for (size_t i = 0; i < s.size(); ++i) {
+        if (!strcmp(s[i].name, name))
+            return &s[i];
+    }
+    return nullptr;
+}
+
+// entries of the same name in all libraries are merged
+static ::capi::stats::snapshot take_merged() {
+    ::capi::stats::snapshot s;
+    ::capi::stats::merge(s, ::capi::stats::take());
+    return s;
+}
+
+// calls in all threads are counted, including exited threads
+static bool test_stats() {
+    const ::capi::stats::snapshot s0 = take_merged();
+    const ::capi::stats::entry* e0 = find(s0, "zlibVersion");
+    CHECK(e0);
+    call_in_threads(8, 1000);
+    call_in_threads(8, 1000); // new threads reuse the counters of exited threads
+    const ::capi::stats::snapshot s = take_merged();
+    const ::capi::stats::entry* e = find(s, "zlibVersion");
+    CHECK(e);
+    CHECK(e->calls - e0->calls == 16*1000);
+    CHECK(find(s, "zError")->calls == find(s0, "zError")->calls);
+# if CAPI_IS(STATS_LATENCY)
+    uint64_t hist = 0;
+    for (int k = 0; k < ::capi::stats::Buckets; ++k)
+        hist += e->hist[k] - e0->hist[k];
+    CHECK(hist == 16*1000);
+# endif
+    ::capi::stats::print(s);
+    return true;
+}
+#endif
+
+#ifdef ZLIB_TEST_FUNCTION
+namespace zlib_fn { // ::capi::function of zstub
+namespace capi {
+extern ::capi::function<const char*()> zlibVersion;
+extern ::capi::function<const char*(int)> zError;
+extern ::capi::function<const char*()> zstub_none;
+}
+static const char* names[] = { "z", NULL };
+CAPI_BEGIN_DLL(names, ::capi::dso)
+CAPI_DEFINE_ENTRY(const char*, zlibVersion, CAPI_ARG0())
+CAPI_DEFINE_ENTRY(const char*, zError, CAPI_ARG1(int))
+CAPI_DEFINE_ENTRY(const char*, zstub_none, CAPI_ARG0())
+CAPI_END_DLL()
+CAPI_DEFINE_NS_DLL
+CAPI_DEFINE_FUNCTION(zlibVersion)
+CAPI_DEFINE_FUNCTION(zError)
+CAPI_DEFINE_FUNCTION(zstub_none)
+} //namespace zlib_fn
+namespace zlib_fn_none { // a library not found
+namespace capi {
+extern ::capi::function<const char*()> zlibVersion;
+}
+static const char* names[] = { "capi_none", NULL };
+CAPI_BEGIN_DLL(names, ::capi::dso)
+CAPI_DEFINE_ENTRY(const char*, zlibVersion, CAPI_ARG0())
+CAPI_END_DLL()
+CAPI_DEFINE_NS_DLL
+CAPI_DEFINE_FUNCTION(zlibVersion)
+} //namespace zlib_fn_none
+
+// a function calls the entry of the same name, and returns R() if it's not resolved
+static bool test_function() {
+    using zlib_fn::api_dll;
+#if CAPI_IS(STATS)
+    const uint64_t calls = find(take_merged(), "zError")->calls;
+#endif
+    CHECK(!strcmp(zlib_fn::capi::zlibVersion(), kStubVersion));
+    CHECK(!strcmp(zlib_fn::capi::zError(-2), "stream error"));
+    CHECK(!strcmp(zlib_fn::capi::zError(-4), "insufficient memory"));
+    api_dll* dll = api_dll::instance();
+    void* const* entries = reinterpret_cast<void* const*>(&dll->api);
+    CHECK(entries[CAPI_ENTRY_INDEX(zError)]); // resolved in the entry
+    CHECK(dll->isAvailable(CAPI_ENTRY_INDEX(zError)));
+    CHECK(!dll->isAvailable(CAPI_ENTRY_INDEX(zstub_none)));
+    CHECK(zlib_fn::capi::zstub_none() == nullptr);
+    CHECK(zlib_fn::capi::zstub_none() == nullptr);
+    CHECK(zlib_fn_none::capi::zlibVersion() == nullptr);
+#if CAPI_IS(STATS)
+    CHECK(find(take_merged(), "zError")->calls - calls == 2);
+#endif
+    return true;
+}
+#endif
+
+#if CAPI_IS(TRACE)
+// records of calls in exited threads are kept, and every thread has a new index even if its ring is reused
+static bool test_trace() {
+    const uint64_t t0 = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    call_in_threads(4, 10);
+    call_in_threads(4, 10);
+    const ::capi::trace::records r = ::capi::trace::take();
+    int loads = 0, calls = 0;
+    std::vector<int> threads;
+    for (size_t i = 0; i < r.size(); ++i) {
+        CHECK(i == 0 || r[i].time >= r[i-1].time);
+        if (r[i].type == ::capi::trace::Load && r[i].result)
+            ++loads;
+        if (r[i].type != ::capi::trace::Call || r[i].time < t0)
+            continue;
+        CHECK(!strcmp(r[i].name, "zlibVersion"));
+        ++calls;
+        if (std::find(threads.begin(), threads.end(), r[i].thread) == threads.end())
+            threads.push_back(r[i].thread);
+    }
+    CHECK(loads > 0);
+    CHECK(calls == 2*4*10);
+    CHECK(threads.size() == 2*4);
+    ::capi::trace::print(r, stdout);
+    return true;
+}
+#endif
+
+#if CAPI_IS(RELOAD)
+// namespace style calls in other threads always call a loaded library while reloading
+static bool test_reload(const std::string& dir) {
+    const char* v = zlib::capi::zlibVersion();
+    CHECK(!zlib::capi::reload()); // the loaded library
+    CHECK(!zlib::capi::reload((dir + "/stub/libz.so.1").c_str()));
+    CHECK(!zlib::capi::reload((dir + "/none/libz.so.1").c_str()));
+    CHECK(zlib::capi::zlibVersion() == v);
+    std::atomic<bool> stop(false);
+    std::atomic<int> errors(0);
+    std::thread caller([&] {
+        while (!stop.load()) {
+            if (strcmp(zlib::capi::zlibVersion(), kStubVersion) || strcmp(zlib::capi::zError(-2), "stream error"))
+                ++errors;
+        }
+    });
+    bool reloaded = zlib::capi::reload((dir + "/stub_copy/libz.so.1").c_str()); // another copy of zstub.c
+    stop = true;
+    caller.join();
+    CHECK(reloaded);
+    CHECK(errors == 0);
+    CHECK(zlib::capi::zlibVersion() != v);
+    CHECK(!strcmp(zlib::capi::zlibVersion(), kStubVersion));
+    CHECK(zlib::capi::has_zError());
+# if CAPI_IS(TRACE)
+    // paths above are temporary strings, records keep copies
+    const std::string path = dir + "/stub_copy/libz.so.1";
+    const ::capi::trace::records r = ::capi::trace::take();
+    int loads = 0;
+    for (size_t i = 0; i < r.size(); ++i) {
+        if (r[i].type == ::capi::trace::Load && r[i].name && r[i].name != path.c_str() && path == r[i].name && r[i].result)
+            ++loads;
+    }
+    CHECK(loads == 1);
+    ::capi::trace::print(r, stdout);
+# endif
+    // preload() and load_all() resolve the object they protect while it's replaced
+    stop = false;
+    std::thread loader([&] {
+        while (!stop.load()) {
+            if (!zlib::capi::preload(true).get() || !::capi::load_all(true, 1)[0].loaded)
+                ++errors;
+        }
+    });
+    int reloads = 0;
+    for (int i = 0; i < 20; ++i)
+        reloads += zlib::capi::reload((dir + (i & 1 ? "/stub_copy" : "/stub") + "/libz.so.1").c_str());
+    stop = true;
+    loader.join();
+    CHECK(reloads == 20);
+    CHECK(errors == 0);
+    return true;
+}
+#endif
+
+#ifdef ZLIB_TEST_LOAD_ALL
+static std::mutex load_order_mutex;
+static std::vector<std::string> load_order; // libraries loaded by ordered_dso
+// record the 1st library name of a dll object when it's loaded
+template<class T> class ordered_dso : public ::capi::dso {
+public:
+    bool load(bool test) {
+        if (!::capi::dso::load(test))
+            return false;
+        std::lock_guard<std::mutex> lock(load_order_mutex);
+        load_order.push_back(T::names[0]);
+        return true;
+    }
+};
+
+namespace zlib_after { // depends on a cycle, and is registered between the dlls in the cycle
+struct library { static const char* names[];};
+const char* library::names[] = { "capi_after", "z", NULL };
+CAPI_BEGIN_DLL(library::names, ordered_dso<library>)
+CAPI_DEFINE_ENTRY(const char*, zlibVersion, CAPI_ARG0())
+CAPI_END_DLL()
+CAPI_DEFINE_NS_DLL
+} //namespace zlib_after
+
+namespace zlib_probe { // another namespace style dll object of zstub, found by probing names
+struct library { static const char* names[];};
+const char* library::names[] = { "capi_none", "z", NULL };
+CAPI_BEGIN_DLL(library::names, ordered_dso<library>)
+CAPI_DEFINE_ENTRY(const char*, zlibVersion, CAPI_ARG0())
+CAPI_END_DLL()
+CAPI_DEFINE_NS_DLL
+} //namespace zlib_probe
+
+// all namespace style dll objects are loaded and resolved by load_all() before any call. must run before any other api object is created
+static bool test_load_all() {
+    ::capi::load_after("z", "capi_none");
+    ::capi::load_after("capi_none", "z"); // a cycle, dependencies between z and capi_none are ignored
+    ::capi::load_after("capi_after", "capi_none"); // depends on a dll in the cycle, still waits for it
+    ::capi::load_after("capi_none", "capi_none"); // ignored
+    ::capi::load_after("z", "capi_unknown"); // not a dll, ignored
+    const std::vector< ::capi::load_result> r = ::capi::load_all(true, 1); // 1 thread, capi_after would be loaded before capi_none if it did not wait
+    CHECK(r.size() == 3);
+    CHECK(!strcmp(r[0].name, "z") && r[0].loaded); // in registration order
+    CHECK(!strcmp(r[1].name, "capi_after") && r[1].loaded);
+    CHECK(!strcmp(r[2].name, "capi_none") && r[2].loaded);
+    CHECK(r[0].us >= 0 && r[1].us >= 0 && r[2].us >= 0);
+    CHECK(load_order.size() == 2 && load_order[0] == "capi_none" && load_order[1] == "capi_after");
+    CHECK(zlib::capi::loaded());
+    CHECK(zlib_probe::capi::loaded());
+    CHECK(zlib_after::capi::loaded());
+    CHECK(zlib::capi::has_zError()); // resolved by load_all()
+    const std::vector< ::capi::load_result> again = ::capi::load_all();
+    CHECK(again.size() == 3 && again[0].loaded && again[1].loaded && again[2].loaded);
+    CHECK(load_order.size() == 2); // loaded once
+    return true;
+}
+#endif
+
+#ifdef ZLIB_TEST_POOL
+namespace zlib_isolated { // every class style api object loads a copy of zstub
+class api_dll;
+class api {
+    api_dll *dll;
+public:
+    api();
+    ~api();
+    bool loaded() const;
+    const char* zlibVersion();
+};
+static const char* names[] = { "z", NULL };
+CAPI_BEGIN_DLL(names, ::capi::isolated_dso)
+CAPI_DEFINE_ENTRY(const char*, zlibVersion, CAPI_ARG0())
+CAPI_END_DLL()
+CAPI_DEFINE_DLL
+CAPI_DEFINE(const char*, zlibVersion, CAPI_ARG0())
+} //namespace zlib_isolated
+
+// objects of a pool are independent copies of the library, acquire() waits if all are in use
+static bool test_pool() {
+    typedef ::capi::pool<zlib_isolated::api> zpool;
+    zpool p(2);
+    CHECK(p.size() == 2);
+    zpool::handle a = p.acquire();
+    zpool::handle b = p.acquire();
+    CHECK(a && b && a.get() != b.get());
+    CHECK(!p.tryAcquire());
+    CHECK(a->loaded() && b->loaded());
+    const char* va = a->zlibVersion();
+    const char* vb = b->zlibVersion();
+    CHECK(!strcmp(va, kStubVersion) && !strcmp(vb, kStubVersion));
+    CHECK(va != vb); // in different link-map namespaces
+    CHECK(va != zlib::capi::zlibVersion());
+    std::atomic<bool> acquired(false);
+    std::thread waiter([&] {
+        zpool::handle c = p.acquire();
+        acquired = true;
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    CHECK(!acquired);
+    {
+        zpool::handle released(std::move(a));
+    }
+    waiter.join();
+    CHECK(acquired);
+    CHECK(!a);
+    zpool::handle c = p.tryAcquire();
+    CHECK(c && c->zlibVersion() == va); // objects are reused
+    return true;
+}
+#endif
+
+// regular files in dir, removed if remove is true
+static std::vector<std::string> files(const std::string& dir, bool remove = false) {
+    std::vector<std::string> f;
+    DIR* d = opendir(dir.c_str());
+    if (!d)
+        return f;
+    while (const dirent* e = readdir(d)) {
+        if (e->d_name[0] == '.')
+            continue;
+        f.push_back(dir + "/" + e->d_name);
+        if (remove)
+            ::remove(f.back().c_str());
+    }
+    closedir(d);
+    return f;
+}
+
+static bool read_file(const std::string& path, std::string& data) {
+    FILE* f = fopen(path.c_str(), "rb");
+    if (!f)
+        return false;
+    char buf[512];
+    data.clear();
+    for (size_t n = 0; (n = fread(buf, 1, sizeof(buf), f)) > 0;)
+        data.append(buf, n);
+    fclose(f);
+    return true;
+}
+
+static bool write_file(const std::string& path, const std::string& data) {
+    FILE* f = fopen(path.c_str(), "wb");
+    if (!f)
+        return false;
+    const bool ok = fwrite(data.data(), 1, data.size(), f) == data.size();
+    return fclose(f) == 0 && ok;
+}
+
+#ifdef ZLIB_TEST_LOAD_FLAGS
+static const int kNoVersion[] = { ::capi::NoVersion, ::capi::EndVersion };
+static const char* undef_names[] = { "capi_undef", NULL }; // libcapi_undef.so of zstub.c has an undefined function
+static const char* z_names[] = { "z", NULL };
+namespace undef_now {
+CAPI_BEGIN_DLL_FLAGS(undef_names, kNoVersion, ::capi::LoadNow, ::capi::dso)
+CAPI_DEFINE_ENTRY(const char*, zlibVersion, CAPI_ARG0())
+CAPI_END_DLL()
+} //namespace undef_now
+namespace undef_lazy {
+CAPI_BEGIN_DLL_FLAGS(undef_names, kNoVersion, 0, ::capi::dso)
+CAPI_DEFINE_ENTRY(const char*, zlibVersion, CAPI_ARG0())
+CAPI_END_DLL()
+} //namespace undef_lazy
+namespace z_local {
+CAPI_BEGIN_DLL(z_names, ::capi::dso)
+CAPI_DEFINE_ENTRY(const char*, zlibVersion, CAPI_ARG0())
+CAPI_END_DLL()
+} //namespace z_local
+namespace z_global {
+CAPI_BEGIN_DLL_FLAGS(z_names, kNoVersion, ::capi::LoadGlobal, ::capi::dso)
+CAPI_DEFINE_ENTRY(const char*, zlibVersion, CAPI_ARG0())
+CAPI_END_DLL()
+} //namespace z_global
+
+// LoadNow binds all symbols when loading, so a library with an undefined function fails to load. LoadGlobal makes symbols visible to dlsym(RTLD_DEFAULT).
+// must run before any other api object is created
+static bool test_load_flags() {
+    undef_now::api_dll* now = new undef_now::api_dll();
+    CHECK(!now->isLoaded());
+    delete now;
+    undef_lazy::api_dll* lazy = new undef_lazy::api_dll();
+    CHECK(lazy->isLoaded());
+    delete lazy;
+    CHECK(!dlsym(RTLD_DEFAULT, "zstub_cpu"));
+    z_local::api_dll* local = new z_local::api_dll();
+    CHECK(local->isLoaded());
+    CHECK(!dlsym(RTLD_DEFAULT, "zstub_cpu"));
+    z_global::api_dll* global = new z_global::api_dll();
+    CHECK(global->isLoaded());
+    const char* (*cpu)() = reinterpret_cast<const char* (*)()>(dlsym(RTLD_DEFAULT, "zstub_cpu")); // zlibVersion is also defined by zlib_api.cpp
+    CHECK(cpu && !strcmp(cpu(), "generic"));
+    delete global;
+    delete local;
+    return true;
+}
+#endif
+
+#ifdef ZLIB_TEST_VERSIONED
+static const char* ver_names[] = { "capi_ver", NULL }; // libcapi_ver.so of zstub.c has zstub_abi@ZSTUB_1 and zstub_abi@@ZSTUB_2
+namespace ver_old {
+namespace capi {
+extern ::capi::function<const char*()> zstub_abi;
+extern ::capi::function<const char*()> zlibVersion;
+}
+CAPI_BEGIN_DLL(ver_names, ::capi::dso)
+CAPI_DEFINE_VER_ENTRY(const char*, zstub_abi, "ZSTUB_1", CAPI_ARG0())
+CAPI_DEFINE_VER_ENTRY(const char*, zlibVersion, "ZSTUB_9", CAPI_ARG0()) // no such version
+CAPI_END_DLL()
+CAPI_DEFINE_NS_DLL
+CAPI_DEFINE_FUNCTION(zstub_abi)
+CAPI_DEFINE_FUNCTION(zlibVersion)
+} //namespace ver_old
+namespace ver_default {
+namespace capi {
+extern ::capi::function<const char*()> zstub_abi;
+}
+CAPI_BEGIN_DLL(ver_names, ::capi::dso)
+CAPI_DEFINE_ENTRY(const char*, zstub_abi, CAPI_ARG0())
+CAPI_END_DLL()
+CAPI_DEFINE_NS_DLL
+CAPI_DEFINE_FUNCTION(zstub_abi)
+} //namespace ver_default
+
+// the requested version of a symbol is bound, and the default version if the requested one does not exist
+static bool test_versioned() {
+    using ver_old::api_dll;
+    CHECK(ver_old::capi::zstub_abi() && !strcmp(ver_old::capi::zstub_abi(), "1"));
+    CHECK(ver_old::capi::zlibVersion() && !strcmp(ver_old::capi::zlibVersion(), kStubVersion));
+    CHECK(api_dll::instance()->isAvailable(CAPI_ENTRY_INDEX(zlibVersion)));
+    CHECK(ver_default::capi::zstub_abi() && !strcmp(ver_default::capi::zstub_abi(), "2"));
+    return true;
+}
+#endif
+
+#ifdef ZLIB_TEST_PRELOAD
+// preload(true) loads and publishes all available entries in a new thread. must run before any other api object is created
+static bool test_preload() {
+    using zlib::api_dll;
+    std::shared_future<bool> f = zlib::capi::preload(true);
+    CHECK(f.get());
+    CHECK(zlib::capi::loaded());
+    api_dll* dll = api_dll::instance();
+    CHECK(dll->isLoaded());
+    CHECK(dll->isAvailable(CAPI_ENTRY_INDEX(zlibVersion)) && dll->isAvailable(CAPI_ENTRY_INDEX(zError)));
+    const std::atomic<void*>* init = ::capi::internal::initial_entries<api_dll::api_t>();
+    const std::atomic<void*>* e = reinterpret_cast<const std::atomic<void*>*>(&dll->api);
+    for (int i = 0; i < api_dll::entry_count; ++i) {
+        if (dll->isAvailable(i))
+            CHECK(e[i].load() && e[i].load() != init[i].load()); // published, not a null or trampoline stub
+    }
+    CHECK(!strcmp(zlib::capi::zlibVersion(), kStubVersion));
+    return true;
+}
+#endif
+
+#ifdef ZLIB_TEST_SYMBOL_CACHE
+#if CAPI_IS(LAZY_RESOLVE)
+# error "zlib_test_symbol_cache requires eager mode, all entries are batch resolved in constructor"
+#endif
+namespace zlib_ifunc { // entries of zstub including an ifunc
+static const char* names[] = { "z", NULL };
+CAPI_BEGIN_DLL(names, ::capi::dso)
+CAPI_DEFINE_ENTRY(const char*, zlibVersion, CAPI_ARG0())
+CAPI_DEFINE_ENTRY(const char*, zstub_cpu, CAPI_ARG0())
+CAPI_END_DLL()
+} //namespace zlib_ifunc
+
+template<class D> static void* const* entries(const D* dll) { return reinterpret_cast<void* const*>(&dll->api);}
+
+// a cache hit is used without lookup, a file of another build-id or a corrupt file is resolved by lookup and saved again, an ifunc is never cached
+static bool test_symbol_cache(const std::string& dir) {
+    using zlib::api_dll;
+    enum { BuildId = 24, Header = 88 }; // offset of build_id and size of symbol_cache::header, followed by int64 offsets
+    const int v = CAPI_ENTRY_INDEX(zlibVersion), e = CAPI_ENTRY_INDEX(zError);
+    ::capi::setSymbolCacheDir(dir.c_str());
+    files(dir, true);
+    api_dll* keep = new api_dll(); // keeps the library at the same address
+    void* const* addrs = entries(keep);
+    CHECK(addrs[v] && addrs[e]);
+    std::vector<std::string> f = files(dir);
+    CHECK(f.size() == 1);
+    std::string data;
+    CHECK(read_file(f[0], data) && data.size() == Header + 2*8);
+    std::string swapped(data);
+    swapped.replace(Header + v*8, 8, data, Header + e*8, 8);
+    swapped.replace(Header + e*8, 8, data, Header + v*8, 8);
+    CHECK(write_file(f[0], swapped));
+    api_dll* d = new api_dll();
+    CHECK(entries(d)[v] == addrs[e] && entries(d)[e] == addrs[v]); // from cache
+    delete d;
+    std::string bad[] = { swapped, swapped, swapped.substr(0, Header + 8), std::string() };
+    bad[0][BuildId] ^= 1;
+    bad[1][0] = 'x';
+    for (size_t i = 0; i < sizeof(bad)/sizeof(bad[0]); ++i) {
+        CHECK(write_file(f[0], bad[i]));
+        d = new api_dll();
+        CHECK(entries(d)[v] == addrs[v] && entries(d)[e] == addrs[e]);
+        delete d;
+        std::string saved;
+        CHECK(read_file(f[0], saved) && saved == data);
+    }
+    files(dir, true);
+    for (int i = 0; i < 2; ++i) { // save, then load from cache
+        zlib_ifunc::api_dll* z = new zlib_ifunc::api_dll();
+        const char* (*cpu)() = reinterpret_cast<const char* (*)()>(entries(z)[1]);
+        CHECK(cpu && !strcmp(cpu(), "generic"));
+        delete z;
+        f = files(dir);
+        CHECK(f.size() == 1);
+        CHECK(read_file(f[0], data) && data.size() == Header + 2*8);
+        int64_t offsets[2];
+        memcpy(offsets, &data[Header], sizeof(offsets));
+        CHECK(offsets[0] >= 0 && offsets[1] == -1);
+    }
+    delete keep;
+    return true;
+}
+#endif
+
+#ifdef ZLIB_TEST_PROBE_CACHE
+#if CAPI_IS(LAZY_RESOLVE)
+# error "zlib_test_probe_cache requires eager mode, the loaded file is found by a resolved entry"
+#endif
+// a dll object of zstub with its own probe cache key "capi_<key>,z|-1"
+#define PROBE_DLL(key) \
+    namespace probe_##key { \
+    static const char* names[] = { "capi_" #key, "z", NULL }; \
+    CAPI_BEGIN_DLL(names, ::capi::dso) \
+    CAPI_DEFINE_ENTRY(const char*, zlibVersion, CAPI_ARG0()) \
+    CAPI_END_DLL() \
+    }
+PROBE_DLL(hit)
+PROBE_DLL(inode)
+PROBE_DLL(mtime)
+PROBE_DLL(size)
+PROBE_DLL(stale)
+PROBE_DLL(t0)
+PROBE_DLL(t1)
+PROBE_DLL(t2)
+PROBE_DLL(t3)
+
+// the file where entries of a dll object are resolved from
+template<class D> static std::string loaded_file(D* dll) {
+    Dl_info info;
+    void* f = reinterpret_cast<void* const*>(&dll->api)[0];
+    return f && dladdr(f, &info) && info.dli_fname ? info.dli_fname : "";
+}
+
+static std::string probe_line(const char* key, unsigned long long ino, long long mtime, unsigned long long size, const std::string& path) {
+    char line[1024];
+    snprintf(line, sizeof(line), "capi_%s,z|-1\t%llu\t%lld\t%llu\t%s\n", key, ino, mtime, size, path.c_str());
+    return line;
+}
+
+// the cached path is loaded if the file is not changed, otherwise names are probed and the new path is saved.
+// lines saved by other dll objects, threads and processes are merged. must run before any other api object is created
+static bool test_probe_cache(const std::string& dir) {
+    const std::string file = dir + "/probe_cache.txt", copy = dir + "/stub_copy/libz.so.1";
+    struct stat st;
+    CHECK(stat(copy.c_str(), &st) == 0);
+    const unsigned long long ino = st.st_ino, size = st.st_size;
+    const long long mtime = st.st_mtime;
+    const std::string other = "other\t1\t2\t3\t/other/libz.so\n"; // a line of another library
+    CHECK(write_file(file, probe_line("hit", ino, mtime, size, copy)
+        + probe_line("inode", ino + 1, mtime, size, copy)
+        + probe_line("mtime", ino, mtime - 1, size, copy)
+        + probe_line("size", ino, mtime, size + 1, copy)
+        + probe_line("stale", ino, mtime, size, dir + "/capi_none/libz.so.1")
+        + other));
+    ::capi::setProbeCacheFile(file.c_str());
+
+    probe_hit::api_dll* hit = new probe_hit::api_dll();
+    CHECK(loaded_file(hit) == copy); // not probed
+    delete hit;
+    probe_inode::api_dll* inode_changed = new probe_inode::api_dll();
+    CHECK(loaded_file(inode_changed).find("/stub/") != std::string::npos);
+    probe_mtime::api_dll* mtime_changed = new probe_mtime::api_dll();
+    CHECK(loaded_file(mtime_changed).find("/stub/") != std::string::npos);
+    probe_size::api_dll* size_changed = new probe_size::api_dll();
+    CHECK(loaded_file(size_changed).find("/stub/") != std::string::npos);
+    probe_stale::api_dll* stale = new probe_stale::api_dll();
+    CHECK(loaded_file(stale).find("/stub/") != std::string::npos);
+    const std::string probed = loaded_file(stale);
+    delete inode_changed;
+    delete mtime_changed;
+    delete size_changed;
+    delete stale;
+
+    std::string data;
+    const std::string external = "external\t1\t2\t3\t/external/libz.so\n"; // saved by another process
+    CHECK(read_file(file, data) && write_file(file, data + external));
+    std::vector<std::thread> threads; // saves in threads are serialized
+    threads.push_back(std::thread([] { delete new probe_t0::api_dll(); }));
+    threads.push_back(std::thread([] { delete new probe_t1::api_dll(); }));
+    threads.push_back(std::thread([] { delete new probe_t2::api_dll(); }));
+    threads.push_back(std::thread([] { delete new probe_t3::api_dll(); }));
+    for (size_t i = 0; i < threads.size(); ++i)
+        threads[i].join();
+
+    CHECK(read_file(file, data));
+    CHECK(stat(probed.c_str(), &st) == 0);
+    const char* saved[] = { "inode", "mtime", "size", "stale", "t0", "t1", "t2", "t3" };
+    for (size_t i = 0; i < sizeof(saved)/sizeof(saved[0]); ++i) {
+        const std::string line = probe_line(saved[i], st.st_ino, st.st_mtime, st.st_size, probed);
+        CHECK(data.find(line) != std::string::npos);
+        CHECK(data.find(line) == data.rfind(line));
+    }
+    CHECK(data.find(probe_line("hit", ino, mtime, size, copy)) != std::string::npos);
+    CHECK(data.find(other) != std::string::npos);
+    CHECK(data.find(external) != std::string::npos);
+    CHECK(std::count(data.begin(), data.end(), '\n') == 11);
+    return true;
+}
+#endif
+
+#if CAPI_IS(PROFILE_RESOLVE)
+// number of profiles in dir, removed if remove is true
+static int profiles(const std::string& dir, bool remove) {
+    DIR* d = opendir(dir.c_str());
+    if (!d)
+        return 0;
+    int n = 0;
+    while (const dirent* e = readdir(d)) {
+        const size_t len = strlen(e->d_name);
+        if (len < 5 || strcmp(e->d_name + len - 5, ".used"))
+            continue;
+        ++n;
+        if (remove)
+            ::remove((dir + "/" + e->d_name).c_str());
+    }
+    closedir(d);
+    return n;
+}
+
+// entries called by the 1st dll object are saved when it's destroyed, and resolved in background by the next one. must run before any other api object is created
+static bool test_profile(const std::string& dir) {
+    ::capi::setSymbolCacheDir(dir.c_str());
+    profiles(dir, true);
+    {
+        zlib::api z;
+        CHECK(!strcmp(z.zlibVersion(), kStubVersion));
+        CHECK(!strcmp(z.zError(0), ""));
+    }
+    CHECK(profiles(dir, false) == 1);
+    zlib::api z;
+    zlib::api_dll* dll = zlib::api_dll::instance(); // the same object of z
+    CHECK(dll->warmup.valid());
+    CHECK(dll->warmup.get() == 2);
+    CHECK(!strcmp(z.zError(-2), "stream error"));
+    return true;
+}
+#endif
+
+int main(int argc, char** argv)
+{
+    const std::string dir = argc > 1 ? argv[1] : ".";
+    bool ok = true;
+#ifdef ZLIB_TEST_LOAD_ALL
+    ok = test_load_all() && ok;
+#endif
+#ifdef ZLIB_TEST_LOAD_FLAGS
+    ok = test_load_flags() && ok;
+#endif
+#ifdef ZLIB_TEST_VERSIONED
+    ok = test_versioned() && ok;
+#endif
+#ifdef ZLIB_TEST_PRELOAD
+    ok = test_preload() && ok;
+#endif
+#ifdef ZLIB_TEST_PROBE_CACHE
+    ok = test_probe_cache(dir) && ok;
+#endif
+#ifdef ZLIB_TEST_SYMBOL_CACHE
+    ok = test_symbol_cache(dir + "/symbols") && ok;
+#endif
+#if CAPI_IS(PROFILE_RESOLVE)
+    ok = test_profile(dir + "/profile") && ok;
+#endif
+    ok = test_calls() && ok;
+    ok = test_entry_index() && ok;
+    ok = test_async() && ok;
+#ifdef ZLIB_TEST_FUNCTION
+    ok = test_function() && ok;
+#endif
+#if CAPI_IS(STATS)
+    ok = test_stats() && ok;
+#endif
+#if CAPI_IS(TRACE)
+    ok = test_trace() && ok;
+#endif
+#if CAPI_IS(RELOAD)
+    ok = test_reload(dir) && ok;
+#endif
+#ifdef ZLIB_TEST_POOL
+    ok = test_pool() && ok;
+#endif
+    printf("%s\n", ok ? "passed" : "FAILED");
+    return ok ? 0 : 1;
+}
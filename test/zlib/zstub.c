@@ -0,0 +1,55 @@
+/******************************************************************************
+    A stub zlib used by zlib_bench, so results do not depend on system zlib
+    Copyright (C) 2014 Wang Bin <wbsecg1@gmail.com>
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+******************************************************************************/
+// only the functions in zlib_api.h. they do nothing, so a benchmark measures the cost of calling them
+#ifdef _WIN32
+#define ZSTUB_EXPORT __declspec(dllexport)
+#else
+#define ZSTUB_EXPORT __attribute__((visibility("default")))
+#endif
+
+ZSTUB_EXPORT const char* zlibVersion(void) { return "1.2.11.stub"; }
+
+ZSTUB_EXPORT const char* zError(int err)
+{
+    static const char* const msg[] = { "need dictionary", "stream end", "", "file error", "stream error", "data error", "insufficient memory", "buffer error", "incompatible version" };
+    if (err < -6 || err > 2)
+        return "";
+    return msg[2 - err];
+}
+
+#if defined(__ELF__) && defined(__GNUC__)
+// not in zlib. an ifunc like memcpy of glibc, the implementation is selected for the cpu when it's resolved, see zlib_test_symbol_cache
+static const char* zstub_cpu_generic(void) { return "generic"; }
+static const char* (*zstub_cpu_resolver(void))(void) { return zstub_cpu_generic; }
+ZSTUB_EXPORT const char* zstub_cpu(void) __attribute__((ifunc("zstub_cpu_resolver")));
+#endif
+
+#ifdef ZSTUB_UNDEFINED
+// not in zlib. an undefined function, so the library can be loaded lazily but not with RTLD_NOW, see zlib_test_load_flags
+extern int zstub_undefined(void);
+ZSTUB_EXPORT int zstub_lazy(void) { return zstub_undefined(); }
+#endif
+
+#if defined(ZSTUB_VERSIONED) && defined(__ELF__) && defined(__GNUC__)
+// not in zlib. 2 versions of zstub_abi, ZSTUB_2 is the default. versions are defined by zstub.map, see zlib_test_versioned
+ZSTUB_EXPORT const char* zstub_abi_1(void) { return "1"; }
+ZSTUB_EXPORT const char* zstub_abi_2(void) { return "2"; }
+__asm__(".symver zstub_abi_1,zstub_abi@ZSTUB_1");
+__asm__(".symver zstub_abi_2,zstub_abi@@ZSTUB_2");
+#endif